@@ -1,40 +1,150 @@
 #include "cdi.h"
+#include "timing.h"
 #include "timer.h"
+#include "vtimer.h"
+#include "latency.h"
+#include "trace.h"
+#include "event.h"
+#include "store.h"
+#ifdef TIMER_STATIC_1
+#include "timer_static.h"
+#endif
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include <stddef.h>
+#include <string.h>
 
 /****************************************************************************
  * Private types/enumerations/variables                                     *
  ****************************************************************************/
 
-EEMEM CdiTimingRecord recordsEeprom[CDI_TIMING_RECORD_SLOTS] = {
-        { .rps = CDI_RPM_MIN / 60,                         .timing = CDI_TIMING_UNDER_LOW },
-        { .rps = CDI_RPM_LOW / 60,                         .timing = CDI_TIMING_UNDER_LOW +     CDI_TIMING_INCR },
-        { .rps = CDI_RPM_LOW / 60 +     CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 2 * CDI_TIMING_INCR },
-        { .rps = CDI_RPM_LOW / 60 + 2 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 3 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_LOW / 60 + 3 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 4 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_LOW / 60 + 4 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 5 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_LOW / 60 + 5 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 6 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_LOW / 60 + 6 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 7 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_LOW / 60 + 7 * CDI_RPM_INCR / 60, .timing = CDI_TIMING_UNDER_LOW + 8 * CDI_TIMING_INCR},
-        { .rps = CDI_RPM_HIGH / 60,                        .timing = CDI_TIMING_OVER_HIGH },
-        { .rps = CDI_RPM_MAX / 60,                         .timing = CDI_TIMING_OVER_HIGH },
+#ifdef TIMER_STATIC_1
+#define meterSetCompare(event, value)  timer_staticSetCompare(1, event, value)
+#define meterClearCompare(event)       timer_staticClearCompare(1, event)
+#define meterGet()                     timer_staticGet(1)
+#define meterGetStamp()                timer_staticGetStamp1(&timer1)
+#define meterGetCapture()              timer_staticGetCapture1(&timer1)
+#define meterSetCapture(capture)       timer_staticSetCapture1(&timer1, capture)
+#else
+#define meterSetCompare(event, value)  timer_setCompare(&timer1, event, value)
+#define meterClearCompare(event)       timer_clearCompare(&timer1, event)
+#define meterGet()                     timer_get(&timer1)
+#define meterGetStamp()                timer_getStamp(&timer1)
+#define meterGetCapture()              timer_getCapture(&timer1)
+#define meterSetCapture(capture)       timer_setCapture(&timer1, capture)
+#endif
+
+typedef struct _CdiSettings {
+    uint8_t map;
+    uint8_t crankRps;
+    CdiPredictor predictor;
+    uint8_t dwell;
+} CdiSettings;
+
+#define CDI_MAP_SIZE       STORE_SLOT_SIZE(sizeof(CdiTable))
+#define CDI_SETTINGS_SIZE  STORE_SLOT_SIZE(sizeof(CdiSettings))
+
+//NOTE: The EEPROM image starts erased, a slot without a valid copy falls
+//      back to the defaults in flash
+static const CdiTable tableDefault PROGMEM = CDI_TABLE_DEFAULT;
+
+EEMEM uint8_t mapsEeprom[CDI_MAPS][CDI_MAP_SIZE] = {
+        [0 ... CDI_MAPS - 1] = { [0 ... CDI_MAP_SIZE - 1] = STORE_ERASED }
 };
+EEMEM uint8_t settingsEeprom[CDI_SETTINGS_SIZE] = {
+        [0 ... CDI_SETTINGS_SIZE - 1] = STORE_ERASED
+};
+
+_Static_assert(CDI_MAPS * CDI_MAP_SIZE + CDI_SETTINGS_SIZE <= E2END + 1,
+               "The maps do not fit the EEPROM");
+
+//NOTE: A save writes the active map first and then the settings
+typedef enum CDI_SAVE {
+    CDI_SAVE_IDLE = 0,
+    CDI_SAVE_SETTINGS = 1,
+    CDI_SAVE_MAP = 2
+} CdiSave;
+
+typedef enum CDI_COIL {
+    CDI_COIL_IDLE = 0,
+    CDI_COIL_CHARGE,
+    CDI_COIL_DWELL,
+    CDI_COIL_SPARK
+} CdiCoil;
 
-EEMEM uint8_t globalShiftEeprom = CDI_SHIFT_DEFAULT;
+//NOTE: The ISRs only bump these 8-bit tallies, one per spark first, and
+//      the main loop folds them into the saturating counters well before
+//      they can wrap
+typedef enum CDI_TALLY {
+    CDI_TALLY_SPARKS = 0,
+    CDI_TALLY_TEETH = CDI_SPARKS,
+    CDI_TALLY_SKIPPED,
+    CDI_TALLY_REJECTED,
+    CDI_TALLY_RESYNCS
+} CdiTally;
 
-static CdiTimingRecord records[CDI_TIMING_RECORD_SLOTS];
-static uint8_t globalShift;
-static Timer timer0, timer1;
+#define CDI_TALLIES  (CDI_TALLY_RESYNCS + 1)
+
+static CdiTable tables[2];
+static CdiTable *table = &tables[0];
+static CdiTable *shadow = &tables[1];
+static TimingSegment segments[CDI_TIMING_RECORD_SLOTS];
+static uint8_t map;
+static CdiSettings saved;
+static CdiSave saving;
+static uint8_t crankRps, crankTeeth;
+static uint32_t crankEnter, crankExit;
+static volatile bool cranking;
+static CdiPredictor predictor;
+static TimingPredictor trend;
+static uint32_t predictions[2];
+static volatile uint32_t forecast;
+static uint8_t dwell;
+static uint16_t dwellTicks;
+static CdiCoil coils[CDI_SPARKS];
+static uint16_t chargeAt[CDI_SPARKS];
+static uint16_t sparkAt[CDI_SPARKS];
+static bool sparkSet[CDI_SPARKS];
+static Timer timer1;
+static VTimer stallTimer;
+#ifdef LATENCY_STATS
+#if CDI_FREQUENCY_HZ != (F_CPU >> LATENCY_METER_SHIFT)
+#error "The latency clock needs the meter at F_CPU >> LATENCY_METER_SHIFT"
+#endif
+static Latency latencies[CDI_LATENCIES];
+#endif
 static volatile uint8_t tickIndex, senseIndex;
 static uint8_t indexes[CDI_TICKS];
 static uint16_t ticks[CDI_TICKS];
-static uint8_t rps;
-static volatile CdiSpark spark;
-static volatile uint32_t waitCycles, cycleIndex;
+static uint16_t gates[CDI_TICKS];
+static volatile bool gated;
+static volatile uint32_t period;
 static volatile bool captured;
+static bool learned, launching;
+static uint32_t launch;
+static volatile uint32_t launched;
+static uint8_t faults;
+static uint16_t rejected, resyncs;
+static uint16_t stats[CDI_STATS];
+static volatile uint8_t tallies[CDI_TALLIES];
+static uint8_t folded[CDI_TALLIES];
+static volatile uint16_t sparkStamps[CDI_SPARKS];
+static volatile uint16_t rejectStamp, replayStamp;
+static volatile uint8_t rejectIndex, replayIndex;
+static volatile bool replayed;
+static uint16_t edges[CDI_TICKS];
+static uint16_t gaps[CDI_TICKS];
+static uint8_t origin;
+static TimingPlan plans[CDI_TICKS];
+static volatile bool synced, planned;
+static volatile uint8_t generation;
+static volatile uint8_t edgeCount, planEdges;
+static uint8_t seenEdges;
+static uint32_t planSpan;
+static uint8_t planDraft, planBase;
 
 /****************************************************************************
  * Public types/enumerations/variables                                      *
@@ -44,21 +154,104 @@ static volatile bool captured;
  * Private functions                                                        *
  ****************************************************************************/
 
-static void calcRps(void) {
-    uint32_t tickSum = 0;
-    for (uint8_t i = 0; i < CDI_TICKS; i++) {
-        tickSum += ticks[i];
-    }
-    rps = CDI_FREQUENCY_HZ / tickSum;
+static void add(uint16_t *counter, uint8_t delta) {
+    *counter = (*counter > UINT16_MAX - delta) ? UINT16_MAX : *counter + delta;
 }
 
-static uint8_t getValue(uint32_t recordRpm) {
-    for (uint8_t i = 0; i < CDI_TIMING_RECORD_SLOTS - 1; i++) {
-        if (recordRpm < records[i + 1].rps) {
-            return (globalShift - records[i].timing);
+static void count(CdiStat stat) {
+    add(&stats[stat], 1);
+}
+
+//NOTE: Also writes the trace records of the sparks and the rejects, the
+//      last one of each since the previous fold
+static void fold(void) {
+    uint8_t taken[CDI_TALLIES];
+    uint8_t delta[CDI_TALLIES];
+#ifdef TRACE_RECORDS
+    uint16_t stamps[CDI_SPARKS];
+    uint16_t rejectAt;
+    uint8_t tooth;
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < CDI_TALLIES; i++) {
+            taken[i] = tallies[i];
+        }
+#ifdef TRACE_RECORDS
+        for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+            stamps[i] = sparkStamps[i];
         }
+        rejectAt = rejectStamp;
+        tooth = rejectIndex;
+#endif
+    }
+    for (uint8_t i = 0; i < CDI_TALLIES; i++) {
+        delta[i] = taken[i] - folded[i];
+        folded[i] = taken[i];
+    }
+    for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+        add(&stats[CDI_STAT_SPARKS], delta[CDI_TALLY_SPARKS + i]);
+#ifdef TRACE_RECORDS
+        if (delta[CDI_TALLY_SPARKS + i] > 0) {
+            trace_put(TRACE_KIND_SPARK, i, stamps[i]);
+        }
+#endif
+    }
+#ifdef TRACE_RECORDS
+    if (delta[CDI_TALLY_REJECTED] > 0) {
+        trace_put(TRACE_KIND_REJECT, tooth, rejectAt);
+    }
+#endif
+    add(&stats[CDI_STAT_TEETH], delta[CDI_TALLY_TEETH]);
+    add(&stats[CDI_STAT_SKIPPED], delta[CDI_TALLY_SKIPPED]);
+    add(&rejected, delta[CDI_TALLY_REJECTED]);
+    add(&resyncs, delta[CDI_TALLY_RESYNCS]);
+}
+
+static void loadMap(CdiTable *target, uint8_t index) {
+    if (!store_load(mapsEeprom[index], target, sizeof(CdiTable))) {
+        memcpy_P(target, &tableDefault, sizeof(CdiTable));
+    }
+    if (target->curve > CDI_CURVE_LINEAR) {
+        target->curve = CDI_CURVE_STEP;
+    }
+}
+
+//NOTE: The settings are copied before the write, the active table stays
+//      unchanged by cdi_commit() until the save is over
+static void save(void) {
+    if (CDI_SAVE_MAP == saving) {
+        store_save(mapsEeprom[map], table, sizeof(CdiTable));
+    } else {
+        saved.map = map;
+        saved.crankRps = crankRps;
+        saved.predictor = predictor;
+        saved.dwell = dwell;
+        store_save(settingsEeprom, &saved, sizeof(CdiSettings));
+    }
+}
+
+static void updateCrank(void) {
+    uint32_t enter = UINT32_MAX;
+    uint32_t leave = UINT32_MAX;
+    uint8_t teeth = (table->shift + CDI_TOOTH_VALUE - 1) / CDI_TOOTH_VALUE;
+
+    //NOTE: While cranking the spark is fired right at the first tooth edge
+    //      at or after the top dead center given by the shift
+    if (teeth >= CDI_TICKS) {
+        teeth = CDI_TICKS - 1;
+    }
+    //NOTE: Zero disables cranking, every revolution is then faster than the
+    //      exit limit and none is slower than the enter limit
+    if (crankRps > 0) {
+        leave = CDI_FREQUENCY_HZ / crankRps;
+        enter = leave + (leave >> CDI_CRANK_HYSTERESIS_SHIFT);
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        crankTeeth = teeth;
+        crankEnter = enter;
+        crankExit = leave;
     }
-    return (globalShift - CDI_TIMING_OVER_HIGH);
 }
 
 static void sparkCharge(CdiSpark spark) {
@@ -77,94 +270,381 @@ static void sparkOut(CdiSpark spark) {
     }
 }
 
-static void ignite(TimerEvent event) {
-    timer_stop(&timer0);
+static void updateDwell(void) {
+    uint16_t result = (uint32_t)dwell * CDI_FREQUENCY_HZ / CDI_DWELL_UNIT_HZ;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dwellTicks = result;
+    }
+}
+
+static TimerEvent getEvent(CdiSpark spark) {
+    if (CDI_SPARK_FRONT == spark) {
+        return TIMER_EVENT_COMPARE_A;
+    }
+    return TIMER_EVENT_COMPARE_B;
+}
+
+//NOTE: A compare value that has already been passed would only match after
+//      a full counter wrap, so such a compare is dropped and reported due
+static bool expire(CdiSpark spark, uint16_t from, uint16_t delay) {
+    meterSetCompare(getEvent(spark), from + delay);
+    if ((uint16_t)(meterGet() - from) >= delay) {
+        meterClearCompare(getEvent(spark));
+        return true;
+    }
+    return false;
+}
+
+static void ignite(CdiSpark spark) {
+    coils[spark] = CDI_COIL_IDLE;
+    sparkSet[spark] = false;
     sparkOut(spark);
+    tallies[CDI_TALLY_SPARKS + spark]++;
+    sparkStamps[spark] = meterGet();
+    //NOTE: The edge to spark time spans the whole delay, so it is kept in
+    //      meter ticks
+    LATENCY_ADD(&latencies[CDI_LATENCY_EDGE], (uint16_t)(meterGet() - meterGetCapture()));
+    if (launching) {
+        launching = false;
+        launched = launch + (uint16_t)(meterGet() - meterGetCapture());
+    }
 }
 
-static void cycle(TimerEvent event) {
-    if (++cycleIndex == waitCycles) {
-        ignite(event);
+static void dwellStart(CdiSpark spark) {
+    sparkCharge(spark);
+    coils[spark] = CDI_COIL_DWELL;
+    if (sparkSet[spark]) {
+        uint16_t delay = sparkAt[spark] - chargeAt[spark];
+        sparkSet[spark] = false;
+        coils[spark] = CDI_COIL_SPARK;
+        if (((int16_t)delay <= 0) || expire(spark, chargeAt[spark], delay)) {
+            ignite(spark);
+        }
     }
 }
 
-static void ready(uint16_t result) {
-    ticks[tickIndex] = result;
-    if (captured) {
-        if (tickIndex == indexes[1]) {
-            sparkCharge(CDI_SPARK_BACK);
-        } else if (tickIndex == indexes[2]) {
-            sparkCharge(CDI_SPARK_FRONT);
-            spark = CDI_SPARK_BACK;
-            calcRps();
-            if (rps < CDI_SENSIBLE_RPS_MIN) {
-                waitCycles = CDI_DELAY_FREQUENCY_HZ * getValue(rps) /
-                        (rps * CDI_SPARKS * CDI_VALUE_MAX);
-                if (timer_configSimple(&timer0, TIMER_0,
-                                       CDI_DELAY_FREQUENCY_HZ,
-                                       cycle, TIMER_OUTPUT_NONE)) {
-                    cycleIndex = 0;
-                    timer_run(&timer0, 0);
-                }
-            } else {
-                uint32_t freq = rps * CDI_SPARKS * CDI_VALUE_MAX / getValue(rps);
-                if (timer_configSimple(&timer0, TIMER_0, freq,
-                                       ignite, TIMER_OUTPUT_NONE)) {
-                    timer_run(&timer0, 0);
-                }
+static void charge(CdiSpark spark, uint16_t delay) {
+    uint16_t edge = meterGetCapture();
+
+    coils[spark] = CDI_COIL_CHARGE;
+    chargeAt[spark] = edge + delay;
+    //NOTE: Only an idle coil is charged, so no spark waits on it yet
+    if (expire(spark, edge, delay)) {
+        sparkCharge(spark);
+        coils[spark] = CDI_COIL_DWELL;
+    }
+}
+
+//NOTE: While the charge compare is still pending the channel is busy, so
+//      the spark time is kept and armed once the dwell has started
+static void arm(CdiSpark spark, uint16_t delay) {
+    uint16_t edge = meterGetCapture();
+
+    if (CDI_COIL_CHARGE == coils[spark]) {
+        sparkAt[spark] = edge + delay;
+        sparkSet[spark] = true;
+        return;
+    }
+    if (CDI_COIL_IDLE == coils[spark]) {
+        sparkCharge(spark);
+    }
+    coils[spark] = CDI_COIL_SPARK;
+    if (expire(spark, edge, delay)) {
+        ignite(spark);
+    }
+}
+
+//NOTE: Edge angles are kept as fractions of a revolution measured from the
+//      edge of indexes[1] and follow the measured wheel with a slow filter
+static void learn(uint32_t revolution, uint8_t filterShift) {
+    uint32_t scale = (1UL << (2 * CDI_FRACTION_SHIFT)) / revolution;
+    uint32_t sum = 0;
+    uint8_t slot = origin;
+
+    for (uint8_t i = 1; i < CDI_TICKS; i++) {
+        slot = (slot + 1) % CDI_TICKS;
+        sum += gaps[slot];
+        uint16_t measured = (sum * scale) >> CDI_FRACTION_SHIFT;
+        edges[slot] += (int16_t)(measured - edges[slot]) >> filterShift;
+    }
+    edges[origin] = 0;
+}
+
+static void release(void) {
+    for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+        if ((CDI_COIL_CHARGE == coils[i]) || (CDI_COIL_SPARK == coils[i])) {
+            tallies[CDI_TALLY_SKIPPED]++;
+        }
+        meterClearCompare(getEvent(i));
+        coils[i] = CDI_COIL_IDLE;
+        sparkSet[i] = false;
+    }
+    planned = false;
+    generation++;
+}
+
+//NOTE: Each edge gets its delays published on its own, the ISR uses them
+//      only once the whole plan of the current sync is in place
+static void plan(uint8_t draft, uint32_t revolution, uint16_t fraction) {
+    for (uint8_t edge = 0; edge < CDI_TICKS; edge++) {
+        TimingPlan next;
+        uint8_t skipped = timing_planEdge(&next, edges, origin, edge,
+                                          revolution, fraction, dwellTicks);
+
+        add(&stats[CDI_STAT_SKIPPED], skipped);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (draft == generation) {
+                plans[edge] = next;
             }
-        } else if (tickIndex == indexes[3]) {
-            spark = CDI_SPARK_FRONT;
-            calcRps();
-            if (rps < CDI_SENSIBLE_RPS_MIN) {
-                waitCycles = CDI_DELAY_FREQUENCY_HZ * getValue(rps) /
-                        (rps * CDI_SPARKS * CDI_VALUE_MAX);
-                if (timer_configSimple(&timer0, TIMER_0,
-                                       CDI_DELAY_FREQUENCY_HZ,
-                                       cycle, TIMER_OUTPUT_NONE)) {
-                    cycleIndex = 0;
-                    timer_run(&timer0, 0);
+        }
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (draft == generation) {
+            planned = true;
+            planEdges = planBase;
+        }
+    }
+}
+
+//NOTE: The short gap ending at indexes[1] is recognised as soon as it is
+//      shorter than both gaps before it by the sync ratio, so the wheel
+//      is synced within a single revolution
+static void sense(void) {
+    uint16_t previous = ticks[(tickIndex + CDI_TICKS - 1) % CDI_TICKS];
+    uint16_t before = ticks[(tickIndex + CDI_TICKS - 2) % CDI_TICKS];
+    uint32_t limit = (uint32_t)ticks[tickIndex] * CDI_SYNC_RATIO_DEN;
+
+    if (senseIndex < CDI_TICKS) {
+        return;
+    }
+    if ((limit < (uint32_t)previous * CDI_SYNC_RATIO_NUM) &&
+            (limit < (uint32_t)before * CDI_SYNC_RATIO_NUM)) {
+        indexes[1] = tickIndex;
+        indexes[2] = (indexes[1] + 1) % CDI_TICKS;
+        indexes[3] = (indexes[1] + 2) % CDI_TICKS;
+        indexes[0] = (indexes[1] + 3) % CDI_TICKS;
+        //NOTE: The oldest gap is not measured yet when the short gap comes
+        //      right after the first three edges, the long gap before it
+        //      stands in for it until the first full revolution
+        if (senseIndex < CDI_SENSE_EDGES) {
+            ticks[indexes[2]] = previous;
+        }
+        release();
+        synced = true;
+        cranking = (crankRps > 0);
+        captured = true;
+    }
+}
+
+static void measure(uint16_t result) {
+    ticks[tickIndex] = result;
+    edgeCount++;
+    if (0 == senseIndex) {
+        launch = 0;
+        launching = true;
+    } else if (launching) {
+        launch += result;
+    }
+    if (senseIndex < CDI_SENSE_EDGES) {
+        senseIndex++;
+    }
+}
+
+//NOTE: Without a timed dwell the coils charge from the edge before their
+//      reference edges
+static void prime(void) {
+    if (tickIndex == indexes[1]) {
+        sparkCharge(CDI_SPARK_BACK);
+    } else if (tickIndex == indexes[2]) {
+        sparkCharge(CDI_SPARK_FRONT);
+    }
+}
+
+static void advance(uint16_t result) {
+    measure(result);
+    if (!captured) {
+        sense();
+    }
+    if (captured && cranking) {
+        prime();
+        //NOTE: Without a plan the sparks fire right at their reference
+        //      edges, the same ones plan() measures the advance from
+        if (tickIndex == indexes[(2 + crankTeeth) % CDI_TICKS]) {
+            ignite(CDI_SPARK_BACK);
+        }
+        if (tickIndex == indexes[(3 + crankTeeth) % CDI_TICKS]) {
+            ignite(CDI_SPARK_FRONT);
+        }
+    } else if (captured) {
+        bool timed = (dwellTicks > 0);
+        //NOTE: A plan is worked out from the revolution up to one edge and
+        //      covers the next revolution. One older than that is left
+        //      alone, the main loop has fallen behind.
+        if (planned && ((uint8_t)(edgeCount - planEdges) <= CDI_TICKS)) {
+            for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+                uint16_t delay = plans[tickIndex].charge[i];
+                if (timed && (TIMING_PLAN_NONE != delay) &&
+                        (CDI_COIL_IDLE == coils[i])) {
+                    charge(i, delay);
                 }
-            } else {
-                uint32_t freq = rps * CDI_SPARKS * CDI_VALUE_MAX / getValue(rps);
-                if (timer_configSimple(&timer0, TIMER_0, freq,
-                                       ignite, TIMER_OUTPUT_NONE)) {
-                    timer_run(&timer0, 0);
+                delay = plans[tickIndex].spark[i];
+                if (TIMING_PLAN_NONE != delay) {
+                    arm(i, delay);
                 }
             }
         }
-        if (CDI_TICKS == ++tickIndex) {
-            tickIndex = 0;
+        if (!timed) {
+            prime();
         }
-    } else {
-        if (CDI_TICKS == ++tickIndex) {
-            tickIndex = 0;
-            if (CDI_SENSE_CYCLES == ++senseIndex) {
-                senseIndex = 0;
-                uint16_t min = UINT16_MAX;
-                for (uint8_t i = 0; i < CDI_TICKS; i++) {
-                    if (ticks[i] < min) {
-                        min = ticks[i];
-                        indexes[1] = i;
-                    }
-                }
-                indexes[2] = (indexes[1] + 1) % CDI_TICKS;
-                indexes[3] = (indexes[1] + 2) % CDI_TICKS;
-                indexes[0] = (indexes[1] + 3) % CDI_TICKS;
-                captured = true;
+    }
+    if (CDI_TICKS == ++tickIndex) {
+        tickIndex = 0;
+    }
+    event_post(EVENT_EDGE);
+}
+
+static void lose(void) {
+    senseIndex = 0;
+    captured = false;
+    gated = false;
+    release();
+    sparkCharge(CDI_SPARK_FRONT);
+    sparkCharge(CDI_SPARK_BACK);
+}
+
+static bool fault(void) {
+    if (++faults > CDI_FAULTS_MAX) {
+        faults = 0;
+        tallies[CDI_TALLY_RESYNCS]++;
+        lose();
+        return true;
+    }
+    return false;
+}
+
+//NOTE: Every edge is checked against a window that spans the gap of the
+//      same tooth one revolution back and the gap the predictor expects
+//      for it, once the geometry is learned. The window is wider while
+//      cranking, where the engine may double its speed within a
+//      revolution. An early edge is dropped as if it never came and a gap
+//      that spans two teeth is split, the missed edge takes its expected
+//      gap but arms nothing, its sparks are due by then and left to the
+//      main loop to count as skipped. Only repeated faults drop the sync.
+static void ready(uint32_t elapsed) {
+    uint16_t result = (elapsed > UINT16_MAX) ? UINT16_MAX : elapsed;
+
+    tallies[CDI_TALLY_TEETH]++;
+    if (captured) {
+        uint8_t shift = cranking ? CDI_WINDOW_CRANK_SHIFT : CDI_WINDOW_SHIFT;
+        uint8_t next = (tickIndex + 1) % CDI_TICKS;
+        uint16_t expected = ticks[tickIndex];
+        uint16_t predicted = gated ? gates[tickIndex] : expected;
+
+        if (result < timing_windowLow(expected, predicted, shift)) {
+            uint16_t stamp = meterGetCapture();
+            tallies[CDI_TALLY_REJECTED]++;
+            rejectIndex = tickIndex;
+            rejectStamp = stamp;
+            event_post(EVENT_EDGE);
+            if (!fault()) {
+                meterSetCapture(stamp - result);
+                return;
             }
+        } else if (result > timing_windowHigh(expected, predicted, shift)) {
+            uint32_t pair = (uint32_t)expected + ticks[next];
+            uint32_t pairPredicted = gated ? (uint32_t)predicted + gates[next] : pair;
+
+            if (!fault() && (elapsed >= timing_windowLow(pair, pairPredicted, shift)) &&
+                    (elapsed <= timing_windowHigh(pair, pairPredicted, shift))) {
+                elapsed -= predicted;
+                replayIndex = tickIndex;
+                replayStamp = meterGetCapture() - elapsed;
+                replayed = true;
+                measure(predicted);
+                tickIndex = next;
+                result = (elapsed > UINT16_MAX) ? UINT16_MAX : elapsed;
+            }
+        } else {
+            faults = 0;
         }
     }
+    advance(result);
+    //NOTE: Measured from the captured edge, so the entry delay counts too
+    LATENCY_EXIT(&latencies[CDI_LATENCY_CAPTURE], LATENCY_METER(meterGetCapture()));
 }
 
-static void over(TimerEvent event) {
-    if (TIMER_EVENT_OVERFLOW == event) {
-        senseIndex = 0;
-        captured = false;
-        sparkCharge(CDI_SPARK_FRONT);
-        sparkCharge(CDI_SPARK_BACK);
+static void fire(TimerEvent event) {
+    if ((TIMER_EVENT_COMPARE_A == event) || (TIMER_EVENT_COMPARE_B == event)) {
+        CdiSpark spark = CDI_SPARK_BACK;
+        LATENCY_MARK(due, LATENCY_METER((TIMER_EVENT_COMPARE_A == event) ? OCR1A : OCR1B));
+        if (TIMER_EVENT_COMPARE_A == event) {
+            spark = CDI_SPARK_FRONT;
+        }
+        meterClearCompare(event);
+        if (CDI_COIL_CHARGE == coils[spark]) {
+            dwellStart(spark);
+        } else {
+            ignite(spark);
+        }
+        LATENCY_EXIT(&latencies[CDI_LATENCY_SPARK], due);
+    }
+}
+
+//NOTE: The edges are lost when no capture came for longer than a full
+//      revolution at the lowest speed. The check runs on the software timer,
+//      so the meter overflow only has to extend the time stamps.
+static void watch(VTimer *vtimer) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if ((senseIndex > 0) &&
+                (meterGetStamp() - meterGetCapture() > CDI_STALL_TICKS)) {
+            count(CDI_STAT_STALLS);
+            trace_put(TRACE_KIND_STALL, tickIndex, meterGet());
+            lose();
+        }
+    }
+}
+
+//NOTE: The sparks a missed edge would have fired or armed
+static uint8_t miss(uint8_t tooth) {
+    uint8_t skipped = 0;
+
+    if (cranking) {
+        skipped += (tooth == indexes[(2 + crankTeeth) % CDI_TICKS]);
+        skipped += (tooth == indexes[(3 + crankTeeth) % CDI_TICKS]);
+    } else if (planned) {
+        for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+            skipped += (TIMING_PLAN_NONE != plans[tooth].spark[i]);
+        }
+    }
+    return skipped;
+}
+
+#ifdef TRACE_RECORDS
+//NOTE: The edges the ISR took since the last pass are traced as the last
+//      one and a missed one replayed before it, with the delays the plan
+//      had for that edge
+static void chronicle(uint8_t edge, uint16_t stamp, bool armed) {
+    if (armed) {
+        for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+            if ((dwellTicks > 0) && (TIMING_PLAN_NONE != plans[edge].charge[i])) {
+                trace_put(TRACE_KIND_CHARGE, i, plans[edge].charge[i]);
+            }
+            if (TIMING_PLAN_NONE != plans[edge].spark[i]) {
+                trace_put(TRACE_KIND_DELAY, i, plans[edge].spark[i]);
+            }
+        }
     }
+    trace_put(TRACE_KIND_EDGE, edge, stamp);
 }
+#endif
+
+#ifdef TIMER_STATIC_1
+#if 0 == TIMER_STATIC_METER_CS(CDI_FREQUENCY_HZ)
+#error "CDI_FREQUENCY_HZ is not an exact Timer1 prescaler"
+#endif
+TIMER_STATIC_METER_1_ISR(timer1, TIMER_METER_MODE_FREE_RUNNING, fire, ready)
+#endif
 
 /****************************************************************************
  * Public functions                                                         *
@@ -175,40 +655,367 @@ void cdi_init() {
     PORTC |= (1 << PC2) | (1 << PC3);
     DDRD |= (1 << DDD5) | (1 << DDD6);
     PORTD |= (1 << PD5) | (1 << PD6);
-    eeprom_read_block(records, recordsEeprom,
-                      sizeof(CdiTimingRecord) * CDI_TIMING_RECORD_SLOTS);
-    eeprom_read_block(&globalShift, &globalShiftEeprom, sizeof(uint8_t));
-    if (timer_configMeter(&timer1, TIMER_1, CDI_FREQUENCY_HZ, over, ready)) {
+    if (!store_load(settingsEeprom, &saved, sizeof(CdiSettings))) {
+        saved.map = 0;
+        saved.crankRps = CDI_CRANK_RPS_DEFAULT;
+        saved.predictor = CDI_PREDICTOR_AVERAGE;
+        saved.dwell = CDI_DWELL_DEFAULT;
+    }
+    map = saved.map;
+    if (map >= CDI_MAPS) {
+        map = 0;
+    }
+    loadMap(table, map);
+    *shadow = *table;
+    timing_loadSegments(segments, table);
+    crankRps = saved.crankRps;
+    predictor = saved.predictor;
+    dwell = saved.dwell;
+    if (predictor > CDI_PREDICTOR_ACCEL) {
+        predictor = CDI_PREDICTOR_AVERAGE;
+    }
+    updateCrank();
+    updateDwell();
+#ifdef LATENCY_STATS
+    for (uint8_t i = 0; i < CDI_LATENCIES; i++) {
+        latency_reset(&latencies[i]);
+    }
+#endif
+#ifdef TIMER_STATIC_1
+    timer_staticConfigMeter1(&timer1, TIMER_METER_MODE_FREE_RUNNING);
+    timer_staticRun(1, TIMER_STATIC_METER_CS(CDI_FREQUENCY_HZ));
+#else
+    if (timer_configMeter(&timer1, TIMER_1, CDI_FREQUENCY_HZ,
+                          TIMER_METER_MODE_FREE_RUNNING, fire, ready)) {
         timer_run(&timer1, 0);
     }
+#endif
+#ifdef LATENCY_STATS
+    latency_start();
+#endif
+    if (vtimer_configSimple(&stallTimer, CDI_STALL_CHECK_HZ, watch)) {
+        vtimer_run(&stallTimer, 0);
+    }
+}
+
+//NOTE: Runs from the main loop between the edges on a snapshot of the last
+//      one, so the capture ISR only arms the delays worked out here. The
+//      tallies of the ISRs are folded and the trace written here too. A plan
+//      drafted before a resync is dropped by the generation check. A table
+//      change alone plans again from the last measured speed, as long as it
+//      was taken after the last resync.
+void cdi_work(const uint8_t events) {
+    bool ready, fresh = false;
+    bool resync = false;
+    uint8_t edge = 0, sensed = 0, draft, base, skipped = 0;
+#ifdef TRACE_RECORDS
+    uint16_t stamp = 0, replayAt = 0;
+    uint8_t replay = CDI_TICKS;
+    bool armed = false;
+#endif
+
+    if ((events & EVENT_STORE) && (CDI_SAVE_IDLE != saving)) {
+        saving--;
+        if (CDI_SAVE_IDLE != saving) {
+            save();
+        }
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ready = captured;
+        draft = generation;
+        base = edgeCount;
+        if (ready && (base != seenEdges)) {
+            fresh = true;
+            for (uint8_t i = 0; i < CDI_TICKS; i++) {
+                gaps[i] = ticks[i];
+            }
+            origin = indexes[1];
+            edge = (tickIndex + CDI_TICKS - 1) % CDI_TICKS;
+            sensed = senseIndex;
+            resync = synced;
+            synced = false;
+            if (replayed) {
+                skipped = miss(replayIndex);
+            }
+#ifdef TRACE_RECORDS
+            stamp = meterGetCapture();
+            if (replayed) {
+                replay = replayIndex;
+                replayAt = replayStamp;
+            }
+            armed = planned && !cranking &&
+                    ((uint8_t)(base - planEdges) <= CDI_TICKS);
+#endif
+        }
+        replayed = false;
+        seenEdges = base;
+    }
+    fold();
+    add(&stats[CDI_STAT_SKIPPED], skipped);
+#ifdef TRACE_RECORDS
+    if (fresh) {
+        if (replay < CDI_TICKS) {
+            chronicle(replay, replayAt, false);
+        }
+        chronicle(edge, stamp, armed);
+    }
+#endif
+    if (!ready) {
+        return;
+    }
+    if (!fresh) {
+        if ((events & EVENT_TABLE) && (draft == planDraft) && !cranking) {
+            plan(draft, planSpan, timing_getFraction(segments, planSpan));
+        }
+        return;
+    }
+    if (resync) {
+        trend.history = 0;
+        learned = false;
+    }
+    uint32_t revolution = 0;
+    for (uint8_t i = 0; i < CDI_TICKS; i++) {
+        revolution += gaps[i];
+    }
+    //NOTE: A forecast targets the sum two edges ahead, so with an even
+    //      number of teeth it is matched by the parity of the edge
+    uint32_t estimate = timing_predict(&trend, edge, revolution);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        period = revolution;
+        forecast = predictions[edge & 1];
+    }
+    predictions[edge & 1] = estimate;
+    uint32_t span = revolution;
+    if (CDI_PREDICTOR_ACCEL == predictor) {
+        span = estimate;
+    }
+    if (cranking) {
+        if (revolution < crankExit) {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                if (draft == generation) {
+                    cranking = false;
+                }
+            }
+        }
+    } else if (revolution > crankEnter) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            cranking = true;
+            release();
+        }
+    }
+    if (edge == origin) {
+        learn(revolution, learned ? CDI_GEOMETRY_SHIFT : 0);
+        learned = (CDI_SENSE_EDGES == sensed);
+    }
+    //NOTE: Each tooth is expected at its share of the forecast revolution,
+    //      so the edge check follows the speed within a revolution
+    if (learned) {
+        uint16_t mask = (1U << CDI_FRACTION_SHIFT) - 1;
+        uint16_t expects[CDI_TICKS];
+        for (uint8_t i = 0; i < CDI_TICKS; i++) {
+            uint32_t gap = timing_scale(estimate, (edges[i] - edges[(i + CDI_TICKS - 1) % CDI_TICKS]) & mask);
+            expects[i] = (gap > UINT16_MAX) ? UINT16_MAX : gap;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (draft == generation) {
+                for (uint8_t i = 0; i < CDI_TICKS; i++) {
+                    gates[i] = expects[i];
+                }
+                gated = true;
+            }
+        }
+    }
+    planSpan = span;
+    planDraft = draft;
+    planBase = base;
+    if (!cranking) {
+        LATENCY_ENTER(entry);
+        plan(draft, span, timing_getFraction(segments, span));
+        LATENCY_EXIT(&latencies[CDI_LATENCY_PLAN], entry);
+    }
 }
 
 uint8_t cdi_getRps(void) {
-    if (captured) {
-        return rps;
+    uint32_t revolution;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        revolution = period;
+    }
+    if (captured && (revolution > 0)) {
+        return CDI_FREQUENCY_HZ / revolution;
+    }
+    return 0;
+}
+
+void cdi_getPeriods(uint32_t *measured, uint32_t *predicted) {
+    *measured = 0;
+    *predicted = 0;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (captured) {
+            *measured = period;
+            *predicted = forecast;
+        }
+    }
+}
+
+uint32_t cdi_getSyncTime(void) {
+    uint32_t result;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        result = launched;
+    }
+    return result;
+}
+
+void cdi_getFaults(uint16_t *rejectedEdges, uint16_t *resyncCount) {
+    fold();
+    *rejectedEdges = rejected;
+    *resyncCount = resyncs;
+}
+
+uint16_t cdi_getStat(CdiStat stat) {
+    fold();
+    if (stat < CDI_STATS) {
+        return stats[stat];
     }
     return 0;
 }
 
+//NOTE: The records, the shift and the curve are read and written in the
+//      shadow table, the timing follows them only after cdi_commit()
 CdiTimingRecord *getTimingRecord(uint8_t slot) {
-    return &records[slot];
+    return &shadow->records[slot];
 }
 
-void cdi_setTimingRecord(uint8_t slot, const uint8_t rps, const uint8_t timing) {
-    records[slot].rps = rps;
-    records[slot].timing = timing;
+void cdi_setTimingRecord(uint8_t slot, const uint16_t rpm, const uint16_t timing) {
+    shadow->records[slot].rpm = rpm;
+    shadow->records[slot].timing = timing;
 }
 
 uint8_t cdi_getShift(void) {
-    return globalShift;
+    return shadow->shift;
 }
 
 void cdi_setShift(uint8_t shift) {
-    globalShift = shift;
+    shadow->shift = shift;
+}
+
+CdiCurve cdi_getCurve(void) {
+    return shadow->curve;
+}
+
+void cdi_setCurve(CdiCurve newCurve) {
+    shadow->curve = newCurve;
+}
+
+uint8_t cdi_getMap(void) {
+    return map;
+}
+
+bool cdi_isEdited(void) {
+    return 0 != memcmp(shadow, table, sizeof(CdiTable));
+}
+
+//NOTE: The maps are numbered and read from the EEPROM right into the shadow
+//      table on a switch, a RAM copy of each would not fit. A switch is
+//      refused while the shadow table holds edits not committed yet, it
+//      would drop them. SAVE_MEM stores the active table back to the
+//      selected map.
+bool cdi_setMap(uint8_t index) {
+    if ((index >= CDI_MAPS) || (CDI_SAVE_IDLE != saving) || cdi_isEdited()) {
+        return false;
+    }
+    loadMap(shadow, index);
+    map = index;
+    return cdi_commit();
+}
+
+//NOTE: The curve is only read by the planning in the main loop, so the whole
+//      table takes over between two plans, with its segments worked out
+//      right away. The new shadow starts as a copy
+//      of it for the next edit. A commit is refused while the active table
+//      is being saved.
+bool cdi_commit(void) {
+    CdiTable *next = shadow;
+
+    if (CDI_SAVE_IDLE != saving) {
+        return false;
+    }
+
+    shadow = table;
+    table = next;
+    updateCrank();
+    timing_loadSegments(segments, table);
+    *shadow = *table;
+    event_post(EVENT_TABLE);
+    return true;
+}
+
+//NOTE: Drops every edit of the shadow table not committed yet
+void cdi_revert(void) {
+    *shadow = *table;
+}
+
+uint8_t cdi_getCrankRps(void) {
+    return crankRps;
+}
+
+void cdi_setCrankRps(uint8_t newCrankRps) {
+    crankRps = newCrankRps;
+    updateCrank();
+    event_post(EVENT_TABLE);
+}
+
+uint8_t cdi_getDwell(void) {
+    return dwell;
+}
+
+void cdi_setDwell(uint8_t newDwell) {
+    dwell = newDwell;
+    updateDwell();
+    event_post(EVENT_TABLE);
+}
+
+CdiPredictor cdi_getPredictor(void) {
+    return predictor;
+}
+
+void cdi_setPredictor(CdiPredictor newPredictor) {
+    predictor = newPredictor;
+    event_post(EVENT_TABLE);
+}
+
+//NOTE: The average keeps LATENCY_AVERAGE_SHIFT fraction bits. The edge slot
+//      is in meter ticks, the others in CPU cycles.
+bool cdi_takeLatency(CdiLatency slot, uint16_t *min, uint16_t *average,
+                     uint16_t *max) {
+#ifdef LATENCY_STATS
+    Latency latency;
+
+    if (slot >= CDI_LATENCIES) {
+        return false;
+    }
+    latency_take(&latencies[slot], &latency);
+    *min = latency.min;
+    *average = latency.average;
+    *max = latency.max;
+    return true;
+#else
+    return false;
+#endif
+}
+
+//NOTE: The EEPROM is written in the background, see cdi_getSave()
+bool cdi_saveMem(void) {
+    if (CDI_SAVE_IDLE != saving) {
+        return false;
+    }
+    saving = CDI_SAVE_MAP;
+    save();
+    return true;
 }
 
-void cdi_saveMem(void) {
-    eeprom_update_block(records, recordsEeprom,
-                        sizeof(CdiTimingRecord) * CDI_TIMING_RECORD_SLOTS);
-    eeprom_update_block(&globalShift, &globalShiftEeprom, sizeof(uint8_t));
+void cdi_getSave(uint8_t *steps, uint8_t *left) {
+    *steps = saving;
+    *left = (CDI_SAVE_IDLE != saving) ? store_left() : 0;
 }
@@ -13,7 +13,15 @@
 
 #define CDI_VALUE_MAX  180
 
-#define CDI_TIMING_RECORD_SLOTS  11
+//NOTE: Two banks of every map and of the settings fill 1004 B of the 1 KB
+//      EEPROM, 32 slots would leave room for only three maps. Both tables in
+//      RAM take 244 B and the segments of the active one another 300 B.
+#define CDI_TIMING_RECORD_SLOTS  30
+#define CDI_MAPS                  4
+
+//NOTE: Timings are kept in 1 / CDI_TIMING_STEPS of a value unit
+#define CDI_TIMING_FRACTION_BITS  2
+#define CDI_TIMING_STEPS  (1 << CDI_TIMING_FRACTION_BITS)
 
 #define CDI_TIMING_UNDER_LOW  5
 #define CDI_TIMING_INCR       3
@@ -21,32 +29,135 @@
 
 #define CDI_SHIFT_DEFAULT  72
 
+#define CDI_CRANK_RPS_DEFAULT       10
+#define CDI_CRANK_HYSTERESIS_SHIFT   3
+
+#define CDI_DWELL_DEFAULT    30
+#define CDI_DWELL_UNIT_HZ    10000
+#define CDI_DWELL_DUTY_SHIFT  1
+
+#define CDI_FRACTION_SHIFT  14
+#define CDI_SLOPE_SHIFT     16
+
 #define CDI_TICKS  4
 #define CDI_SPARKS  2
-#define CDI_DELAY_FREQUENCY_HZ  (F_CPU / 256)
-#define CDI_SENSE_CYCLES  2
+#define CDI_TOOTH_VALUE  (CDI_SPARKS * CDI_VALUE_MAX / CDI_TICKS)
+#define CDI_SENSE_EDGES  (CDI_TICKS + 1)
+#define CDI_SYNC_RATIO_NUM  3
+#define CDI_SYNC_RATIO_DEN  4
+#define CDI_WINDOW_SHIFT    2
+#define CDI_WINDOW_CRANK_SHIFT  1
+#define CDI_FAULTS_MAX      3
+#define CDI_GEOMETRY_SHIFT  3
+#define CDI_PREDICTOR_HISTORY  (2 * CDI_TICKS)
 #define CDI_SPARK_PWM_DUTY  90
 
 #define CDI_FREQUENCY_HZ  (F_CPU / 64)
-#define CDI_SENSIBLE_RPS_MIN  16  // (F_CPU / (CDI_SPARKS * 1024 * (UINT8_MAX + 1)))
+#define CDI_STALL_TICKS   (CDI_FREQUENCY_HZ * 60UL / CDI_RPM_MIN)
+#define CDI_STALL_CHECK_HZ  20
 
 typedef enum CDI_SPARK {
     CDI_SPARK_FRONT = 0,
     CDI_SPARK_BACK = 1
 } CdiSpark;
 
+typedef enum CDI_CURVE {
+    CDI_CURVE_STEP = 0,
+    CDI_CURVE_LINEAR = 1
+} CdiCurve;
+
+typedef enum CDI_PREDICTOR {
+    CDI_PREDICTOR_AVERAGE = 0,
+    CDI_PREDICTOR_ACCEL = 1
+} CdiPredictor;
+
+typedef enum CDI_LATENCY {
+    CDI_LATENCY_CAPTURE = 0,
+    CDI_LATENCY_SPARK = 1,
+    CDI_LATENCY_EDGE = 2,
+    CDI_LATENCY_PLAN = 3
+} CdiLatency;
+
+#define CDI_LATENCIES  4
+
+typedef enum CDI_STAT {
+    CDI_STAT_TEETH = 0,
+    CDI_STAT_SPARKS = 1,
+    CDI_STAT_SKIPPED = 2,
+    CDI_STAT_STALLS = 3
+} CdiStat;
+
+#define CDI_STATS  4
+
 typedef struct _CdiTimingRecord {
-    uint8_t rps;
-    uint8_t timing;
+    uint16_t rpm;
+    uint16_t timing;
 } CdiTimingRecord;
 
+//NOTE: The part of the settings the remote uploads as a whole map
+typedef struct _CdiTable {
+    CdiTimingRecord records[CDI_TIMING_RECORD_SLOTS];
+    uint8_t shift;
+    CdiCurve curve;
+} CdiTable;
+
+//NOTE: The breakpoints between the low and the high speed are spread evenly,
+//      the list has to follow CDI_TIMING_RECORD_SLOTS
+#define CDI_RECORD_SPAN  (CDI_TIMING_RECORD_SLOTS - 3)
+#define CDI_RECORD_DEFAULT(k) { \
+    .rpm = CDI_RPM_LOW + (k) * (CDI_RPM_HIGH - CDI_RPM_LOW) / CDI_RECORD_SPAN, \
+    .timing = (CDI_TIMING_UNDER_LOW + CDI_TIMING_INCR) * CDI_TIMING_STEPS + \
+              (k) * (CDI_TIMING_OVER_HIGH - CDI_TIMING_UNDER_LOW - CDI_TIMING_INCR) * \
+              CDI_TIMING_STEPS / CDI_RECORD_SPAN \
+}
+
+#define CDI_TABLE_DEFAULT { \
+    .records = { \
+        { .rpm = CDI_RPM_MIN, .timing = CDI_TIMING_UNDER_LOW * CDI_TIMING_STEPS }, \
+        CDI_RECORD_DEFAULT(0), CDI_RECORD_DEFAULT(1), CDI_RECORD_DEFAULT(2), \
+        CDI_RECORD_DEFAULT(3), CDI_RECORD_DEFAULT(4), CDI_RECORD_DEFAULT(5), \
+        CDI_RECORD_DEFAULT(6), CDI_RECORD_DEFAULT(7), CDI_RECORD_DEFAULT(8), \
+        CDI_RECORD_DEFAULT(9), CDI_RECORD_DEFAULT(10), CDI_RECORD_DEFAULT(11), \
+        CDI_RECORD_DEFAULT(12), CDI_RECORD_DEFAULT(13), CDI_RECORD_DEFAULT(14), \
+        CDI_RECORD_DEFAULT(15), CDI_RECORD_DEFAULT(16), CDI_RECORD_DEFAULT(17), \
+        CDI_RECORD_DEFAULT(18), CDI_RECORD_DEFAULT(19), CDI_RECORD_DEFAULT(20), \
+        CDI_RECORD_DEFAULT(21), CDI_RECORD_DEFAULT(22), CDI_RECORD_DEFAULT(23), \
+        CDI_RECORD_DEFAULT(24), CDI_RECORD_DEFAULT(25), CDI_RECORD_DEFAULT(26), \
+        CDI_RECORD_DEFAULT(27), \
+        { .rpm = CDI_RPM_MAX, .timing = CDI_TIMING_OVER_HIGH * CDI_TIMING_STEPS }, \
+    }, \
+    .shift = CDI_SHIFT_DEFAULT, \
+    .curve = CDI_CURVE_STEP \
+}
+
 void cdi_init();
+void cdi_work(const uint8_t events);
 uint8_t cdi_getRps(void);
+void cdi_getPeriods(uint32_t *measured, uint32_t *predicted);
+uint32_t cdi_getSyncTime(void);
+void cdi_getFaults(uint16_t *rejected, uint16_t *resyncs);
+uint16_t cdi_getStat(CdiStat stat);
 CdiTimingRecord *getTimingRecord(uint8_t slot);
-void cdi_setTimingRecord(uint8_t slot, const uint8_t rps,
-                         const uint8_t timing);
+void cdi_setTimingRecord(uint8_t slot, const uint16_t rpm,
+                         const uint16_t timing);
 uint8_t cdi_getShift(void);
 void cdi_setShift(uint8_t shift);
-void cdi_saveMem(void);
+CdiCurve cdi_getCurve(void);
+void cdi_setCurve(CdiCurve curve);
+bool cdi_commit(void);
+void cdi_revert(void);
+bool cdi_isEdited(void);
+uint8_t cdi_getMap(void);
+bool cdi_setMap(uint8_t index);
+uint8_t cdi_getCrankRps(void);
+void cdi_setCrankRps(uint8_t crankRps);
+uint8_t cdi_getDwell(void);
+void cdi_setDwell(uint8_t dwell);
+CdiPredictor cdi_getPredictor(void);
+void cdi_setPredictor(CdiPredictor predictor);
+bool cdi_takeLatency(CdiLatency slot, uint16_t *min, uint16_t *average,
+                     uint16_t *max);
+bool cdi_saveMem(void);
+void cdi_getSave(uint8_t *steps, uint8_t *left);
 
 #endif /* CDI_H_ */
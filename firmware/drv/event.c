@@ -0,0 +1,53 @@
+#include "event.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+static volatile uint8_t pending;
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+//NOTE: The idle sleep keeps the timers and the USART running, so any
+//      interrupt wakes the core
+void event_init(void) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+void event_post(const uint8_t events) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pending |= events;
+    }
+}
+
+//NOTE: The instruction after sei() is always executed before an interrupt,
+//      so an event posted right after the check still wakes the core
+uint8_t event_wait(void) {
+    uint8_t events;
+
+    cli();
+    while (0 == pending) {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        cli();
+    }
+    events = pending;
+    pending = 0;
+    sei();
+    return events;
+}
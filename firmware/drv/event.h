@@ -0,0 +1,20 @@
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+typedef enum EVENT {
+    EVENT_EDGE = (1 << 0),
+    EVENT_BYTE = (1 << 1),
+    EVENT_TABLE = (1 << 2),
+    EVENT_STORE = (1 << 3),
+    EVENT_SENT = (1 << 4),
+    EVENT_LINK = (1 << 5),
+    EVENT_TIMER = (1 << 6)
+} Event;
+
+void event_init(void);
+void event_post(const uint8_t events);
+uint8_t event_wait(void);
+
+#endif /* EVENT_H_ */
@@ -0,0 +1,79 @@
+#include "latency.h"
+#include <util/atomic.h>
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+#define LATENCY_AVERAGE_MAX  (UINT16_MAX >> LATENCY_AVERAGE_SHIFT)
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+//NOTE: Both prescalers are held in reset while the counters are cleared, so
+//      Timer2 counts the low eight bits of the cycles Timer1 counts in
+//      steps of 1 << LATENCY_METER_SHIFT. The Timer1 clock setup is kept.
+void latency_start(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        GTCCR = (1 << TSM) | (1 << PSRASY) | (1 << PSRSYNC);
+        TCCR2A = 0;
+        TCCR2B = (1 << CS20);
+        TCNT2 = 0;
+        TCNT1 = 0;
+        GTCCR = 0;
+    }
+}
+
+//NOTE: The two counters are not read at the same cycle, so the meter only
+//      picks the 256-cycle span that holds the Timer2 count nearest to it
+uint16_t latency_clock(void) {
+    uint16_t base;
+    uint8_t low;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        base = TCNT1 << LATENCY_METER_SHIFT;
+        low = TCNT2;
+    }
+    return base + (int8_t)(low - (uint8_t)base);
+}
+
+void latency_reset(Latency *latency) {
+    latency->min = UINT16_MAX;
+    latency->max = 0;
+    latency->average = 0;
+}
+
+//NOTE: The average is a running one kept with LATENCY_AVERAGE_SHIFT
+//      fraction bits, so a latency below one tick still shows in it
+void latency_add(Latency *latency, const uint16_t ticks) {
+    uint16_t sample = (ticks > LATENCY_AVERAGE_MAX) ? LATENCY_AVERAGE_MAX : ticks;
+
+    if (latency->min > latency->max) {
+        latency->average = sample << LATENCY_AVERAGE_SHIFT;
+    } else {
+        latency->average -= latency->average >> LATENCY_AVERAGE_SHIFT;
+        latency->average += sample;
+    }
+    if (ticks < latency->min) {
+        latency->min = ticks;
+    }
+    if (ticks > latency->max) {
+        latency->max = ticks;
+    }
+}
+
+void latency_take(Latency *latency, Latency *copy) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *copy = *latency;
+        latency_reset(latency);
+    }
+}
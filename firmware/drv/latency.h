@@ -0,0 +1,48 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <avr/io.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Interrupt latency statistics.                                            *
+ *                                                                          *
+ * Built in only with the LATENCY_STATS flag. The times are counted in CPU  *
+ * cycles: Timer2 runs at the CPU clock and is started together with the    *
+ * free-running Timer1 meter, which gives the upper bits, so Timer2 is not  *
+ * free for other uses in such a build.                                     *
+ ****************************************************************************/
+
+#define LATENCY_CLOCK()        latency_clock()
+#define LATENCY_AVERAGE_SHIFT  3
+#define LATENCY_METER_SHIFT    6
+
+//NOTE: A meter time stamp in CPU cycles, such a stamp is only as fine as
+//      one meter tick
+#define LATENCY_METER(ticks)   ((uint16_t)((ticks) << LATENCY_METER_SHIFT))
+
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint16_t average;
+} Latency;
+
+#ifdef LATENCY_STATS
+#define LATENCY_MARK(stamp, value)    uint16_t stamp = (value)
+#define LATENCY_EXIT(latency, stamp)  latency_add(latency, LATENCY_CLOCK() - (stamp))
+#define LATENCY_ADD(latency, ticks)   latency_add(latency, ticks)
+#else
+#define LATENCY_MARK(stamp, value)
+#define LATENCY_EXIT(latency, stamp)
+#define LATENCY_ADD(latency, ticks)
+#endif
+
+#define LATENCY_ENTER(stamp)  LATENCY_MARK(stamp, LATENCY_CLOCK())
+
+void latency_start(void);
+uint16_t latency_clock(void);
+void latency_reset(Latency *latency);
+void latency_add(Latency *latency, const uint16_t ticks);
+void latency_take(Latency *latency, Latency *copy);
+
+#endif /* LATENCY_H_ */
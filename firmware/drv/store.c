@@ -0,0 +1,148 @@
+#include "store.h"
+#include "event.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+static uint8_t *target;
+static const uint8_t *source;
+static uint8_t length, sequence, crc;
+static volatile uint8_t index, left;
+static volatile bool active;
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+static bool check(const uint8_t *bank, const uint8_t size, uint8_t *number) {
+    uint8_t sum = STORE_CRC_INIT;
+
+    *number = eeprom_read_byte(bank);
+    if (STORE_ERASED == *number) {
+        return false;
+    }
+    for (uint8_t i = 0; i <= size; i++) {
+        sum = _crc8_ccitt_update(sum, eeprom_read_byte(bank + i));
+    }
+    return sum == eeprom_read_byte(bank + size + 1);
+}
+
+//NOTE: Sequence numbers wrap, the newer one is less than half the range
+//      ahead. STORE_BANKS means no valid copy.
+static uint8_t newest(const uint8_t *slot, const uint8_t size,
+                      uint8_t *number) {
+    uint8_t result = STORE_BANKS;
+
+    for (uint8_t i = 0; i < STORE_BANKS; i++) {
+        uint8_t found;
+        if (check(slot + i * STORE_BANK_SIZE(size), size, &found) &&
+                ((STORE_BANKS == result) || ((int8_t)(found - *number) > 0))) {
+            result = i;
+            *number = found;
+        }
+    }
+    return result;
+}
+
+static uint8_t image(const uint8_t position) {
+    if (0 == position) {
+        return sequence;
+    } else if (position <= length) {
+        return source[position - 1];
+    }
+    return crc;
+}
+
+/****************************************************************************
+ * Interrupt handler functions                                              *
+ ****************************************************************************/
+
+//NOTE: One byte per interrupt, the flag stays raised while the EEPROM is
+//      idle, so a byte already holding its value costs only a compare. The
+//      completion is posted only after the last write has finished.
+ISR(EE_READY_vect) {
+    if (index < STORE_BANK_SIZE(length)) {
+        uint8_t value = image(index);
+        EEAR = (uintptr_t)(target + index);
+        index++;
+        left--;
+        EECR |= (1 << EERE);
+        if (EEDR != value) {
+            EEDR = value;
+            EECR |= (1 << EEMPE);
+            EECR |= (1 << EEPE);
+        }
+        return;
+    }
+    EECR &= ~(1 << EERIE);
+    active = false;
+    event_post(EVENT_STORE);
+}
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+bool store_load(const uint8_t *slot, void *data, const uint8_t size) {
+    uint8_t number;
+    uint8_t bank = newest(slot, size, &number);
+
+    if (STORE_BANKS == bank) {
+        return false;
+    }
+    eeprom_read_block(data, slot + bank * STORE_BANK_SIZE(size) + 1, size);
+    return true;
+}
+
+//NOTE: The data is written from its place, so it must stay unchanged until
+//      the EVENT_STORE. The EEPROM is read here only while no save is in
+//      progress, the writer owns the address register meanwhile.
+bool store_save(uint8_t *slot, const void *data, const uint8_t size) {
+    uint8_t number = 0;
+    uint8_t bank;
+
+    if (active) {
+        return false;
+    }
+    bank = newest(slot, size, &number);
+    if (STORE_BANKS == bank) {
+        bank = 0;
+        number = 0;
+    } else {
+        bank = (bank + 1) % STORE_BANKS;
+        number++;
+        if (STORE_ERASED == number) {
+            number = 0;
+        }
+    }
+    target = slot + bank * STORE_BANK_SIZE(size);
+    source = data;
+    length = size;
+    sequence = number;
+    crc = _crc8_ccitt_update(STORE_CRC_INIT, sequence);
+    for (uint8_t i = 0; i < length; i++) {
+        crc = _crc8_ccitt_update(crc, source[i]);
+    }
+    index = 0;
+    left = STORE_BANK_SIZE(length);
+    active = true;
+    EECR |= (1 << EERIE);
+    return true;
+}
+
+bool store_busy(void) {
+    return active;
+}
+
+uint8_t store_left(void) {
+    return left;
+}
@@ -0,0 +1,23 @@
+#ifndef STORE_H_
+#define STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//NOTE: A slot keeps STORE_BANKS copies of a block, each framed by a sequence
+//      number ahead and a CRC-8 behind. A save always goes to the bank not
+//      holding the newest valid copy, so an interrupted one leaves the
+//      previous copy in place.
+#define STORE_BANKS     2
+#define STORE_ERASED    0xFF
+#define STORE_CRC_INIT  0xFF
+
+#define STORE_BANK_SIZE(length)  ((length) + 2)
+#define STORE_SLOT_SIZE(length)  (STORE_BANKS * STORE_BANK_SIZE(length))
+
+bool store_load(const uint8_t *slot, void *data, const uint8_t size);
+bool store_save(uint8_t *slot, const void *data, const uint8_t size);
+bool store_busy(void);
+uint8_t store_left(void);
+
+#endif /* STORE_H_ */
@@ -82,11 +82,23 @@ static bool calc(const TimerIndex index, const uint32_t freq, const bool half,
     return true;
 }
 
+#ifdef TCCR1A
+//NOTE: A pending overflow that is not counted yet belongs to the stamp only
+//      when the counter value was taken after the wrap, so the low half of
+//      the range is checked
+static uint32_t extend(uint16_t epoch, const uint16_t count) {
+    if ((TIFR1 & (1 << TOV1)) && (count < 0x8000)) {
+        epoch++;
+    }
+    return ((uint32_t)epoch << 16) | count;
+}
+#endif
+
 /****************************************************************************
  * Interrupt handler functions                                              *
  ****************************************************************************/
 
-#ifdef TCCR0A
+#if defined(TCCR0A) && !defined(TIMER_STATIC_0)
 ISR(TIMER0_COMPA_vect) {
     if (timer0) {
         if (timer0->handler) {
@@ -112,7 +124,7 @@ ISR(TIMER0_OVF_vect) {
 }
 #endif
 
-#ifdef TCCR1A
+#if defined(TCCR1A) && !defined(TIMER_STATIC_1)
 ISR(TIMER1_COMPA_vect) {
     if (timer1) {
         if (timer1->handler) {
@@ -130,16 +142,29 @@ ISR(TIMER1_COMPB_vect) {
 }
 
 ISR(TIMER1_CAPT_vect) {
-    TCNT1 = 0;
+    uint16_t capture = ICR1;
+
     if (timer1) {
+        uint32_t result = capture;
+        if (TIMER_METER_MODE_FREE_RUNNING == timer1->meterMode) {
+            //NOTE: The counter is never reset so the compare units share the
+            //      same time base with the captured edges, and the edge is
+            //      stamped with the overflow count as the upper word
+            uint32_t stamp = extend(timer1->epoch, capture);
+            result = stamp - timer1->capture;
+            timer1->capture = stamp;
+        } else {
+            TCNT1 = 0;
+        }
         if (timer1->resultHandler) {
-            timer1->resultHandler(ICR1);
+            timer1->resultHandler(result);
         }
     }
 }
 
 ISR(TIMER1_OVF_vect) {
     if (timer1) {
+        timer1->epoch++;
         if (timer1->handler) {
             timer1->handler(TIMER_EVENT_OVERFLOW);
         }
@@ -147,7 +172,7 @@ ISR(TIMER1_OVF_vect) {
 }
 #endif
 
-#ifdef TCCR2A
+#if defined(TCCR2A) && !defined(TIMER_STATIC_2)
 ISR(TIMER2_COMPA_vect) {
     if (timer2) {
         if (timer2->handler) {
@@ -177,85 +202,116 @@ ISR(TIMER2_OVF_vect) {
  * Public functions                                                         *
  ****************************************************************************/
 
-bool timer_configSimple(Timer *timer, TimerIndex index, uint32_t freq,
-                        TimerHandler handler, TimerOutput out) {
+bool timer_calcSimple(const TimerIndex index, const uint32_t freq,
+                      const TimerOutput out, uint8_t *clockSelect,
+                      uint16_t *ocr) {
+    switch (index) {
+#ifdef TCCR0A
+#ifdef TIMER_SIMPLE_0
+        case TIMER_0:
+            return calc(index, freq, (out != TIMER_OUTPUT_NONE),
+                        prescale01, dv01, clockSelect, UINT8_MAX, ocr);
+#endif
+#endif
+#ifdef TCCR1A
+#ifdef TIMER_SIMPLE_1
+        case TIMER_1:
+            return calc(index, freq, (out != TIMER_OUTPUT_NONE),
+                        prescale01, dv01, clockSelect, UINT16_MAX, ocr);
+#endif
+#endif
+#ifdef TCCR2A
+#ifdef TIMER_SIMPLE_2
+        case TIMER_2:
+            return calc(index, freq, (out != TIMER_OUTPUT_NONE),
+                        prescale2, dv2, clockSelect, UINT8_MAX, ocr);
+#endif
+#endif
+        default:
+            return false;
+    }
+}
+
+void timer_loadSimple(Timer *timer, const TimerIndex index,
+                      const uint8_t clockSelect, const uint16_t ocr,
+                      const TimerHandler handler, const TimerOutput out) {
     uint8_t wgm;
-    uint16_t ocr;
+    uint8_t irq = (NULL != handler) ? 1 : 0;
 
     timer->index = index;
     timer->handler = handler;
+    timer->clockSelect = clockSelect;
     switch (index) {
 #ifdef TCCR0A
 #ifdef TIMER_SIMPLE_0
         case TIMER_0:
-            if (!calc(timer->index, freq, (out != TIMER_OUTPUT_NONE),
-                      prescale01, dv01, &timer->clockSelect, UINT8_MAX, &ocr)) {
-                return false;
-            }
             if (0 == ocr) {
                 wgm = TIMER02_WGM_NORMAL;
-                TIMSK0 = (1 << TOIE0);
+                TIMSK0 = (irq << TOIE0);
             } else {
                 wgm = TIMER02_WGM_CTC_OCR;
                 OCR0A = (uint8_t)ocr;
-                TIMSK0 = (1 << OCIE0A);
+                TIMSK0 = (irq << OCIE0A);
             }
             TCCR0A = ((out & 0xF) << COM0B0) | ((wgm & 0x3) << WGM00);
             TCCR0B = (0 << FOC0A) | (0 << FOC0B) | (0 << WGM02);
             timer0 = timer;
-            return true;
+            break;
 #endif
 #endif
 #ifdef TCCR1A
 #ifdef TIMER_SIMPLE_1
         case TIMER_1:
-            if (!calc(timer->index, freq, (out != TIMER_OUTPUT_NONE),
-                      prescale01, dv01, &timer->clockSelect, UINT16_MAX, &ocr)) {
-                return false;
-            }
             if (0 == ocr) {
                 wgm = TIMER1_WGM_NORMAL;
-                TIMSK1 = (1 << TOIE1);
+                TIMSK1 = (irq << TOIE1);
             } else {
                 wgm = TIMER1_WGM_CTC_OCR;
                 OCR1A = ocr;
-                TIMSK1 = (1 << OCIE1A);
+                TIMSK1 = (irq << OCIE1A);
             }
             TCCR1A = ((out & 0xF) << COM1B0) | ((wgm & 0x3) << WGM10);
             TCCR1B = (0 << ICNC1) | (0 << ICES1) | (0 << WGM12);
             TCCR1C = (0 << FOC1A) | (0 << FOC1B);
             timer1 = timer;
-            return true;
+            break;
 #endif
 #endif
 #ifdef TCCR2A
 #ifdef TIMER_SIMPLE_2
         case TIMER_2:
-            if (!calc(timer->index, freq, (out != TIMER_OUTPUT_NONE),
-                      prescale2, dv2, &timer->clockSelect, UINT8_MAX, &ocr)) {
-                return false;
-            }
             if (0 == ocr) {
                 wgm = TIMER02_WGM_NORMAL;
-                TIMSK2 = (1 << TOIE2);
+                TIMSK2 = (irq << TOIE2);
             } else {
                 wgm = TIMER02_WGM_CTC_OCR;
                 OCR2A = (uint8_t)ocr;
-                TIMSK2 = (1 << OCIE2A);
+                TIMSK2 = (irq << OCIE2A);
             }
             TCCR2A = ((out & 0xF) << COM2B0) | ((wgm & 0x3) << WGM20);
             TCCR2B = (0 << FOC2A) | (0 << FOC2B) | (0 << WGM22);
             timer2 = timer;
-            return true;
+            break;
 #endif
 #endif
         default:
             (void)wgm;
-            (void)ocr;
-            return false;
+            break;
     }
 }
 
+bool timer_configSimple(Timer *timer, TimerIndex index, uint32_t freq,
+                        TimerHandler handler, TimerOutput out) {
+    uint8_t clockSelect;
+    uint16_t ocr;
+
+    if (!timer_calcSimple(index, freq, out, &clockSelect, &ocr)) {
+        return false;
+    }
+    timer_loadSimple(timer, index, clockSelect, ocr, handler, out);
+    return true;
+}
+
 bool timer_configPwm(Timer *timer, const TimerIndex index, const uint32_t freq,
                      const TimerPwmMode mode, const uint16_t duty,
                      const TimerHandler handler, const TimerOutput out) {
@@ -452,11 +508,14 @@ void timer_configCounter(Timer *timer, const TimerIndex index,
 }
 
 bool timer_configMeter(Timer *timer, TimerIndex index, uint32_t freq,
-                       const TimerHandler handler,
+                       const TimerMeterMode mode, const TimerHandler handler,
                        TimerResultHandler resultHandler) {
     timer->index = index;
     timer->handler = handler;
     timer->resultHandler = resultHandler;
+    timer->meterMode = mode;
+    timer->epoch = 0;
+    timer->capture = 0;
     switch (index) {
 #ifdef TCCR1A
 #ifdef TIMER_METER_1
@@ -528,6 +587,93 @@ void timer_stop(Timer *timer) {
     }
 }
 
+void timer_setCompare(Timer *timer, const TimerEvent event,
+                      const uint16_t value) {
+    switch (timer->index) {
+#ifdef TCCR0A
+        case TIMER_0:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                OCR0A = (uint8_t)value;
+                TIFR0 = (1 << OCF0A);
+                TIMSK0 |= (1 << OCIE0A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                OCR0B = (uint8_t)value;
+                TIFR0 = (1 << OCF0B);
+                TIMSK0 |= (1 << OCIE0B);
+            }
+            break;
+#endif
+#ifdef TCCR1A
+        case TIMER_1:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                OCR1A = value;
+                TIFR1 = (1 << OCF1A);
+                TIMSK1 |= (1 << OCIE1A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                OCR1B = value;
+                TIFR1 = (1 << OCF1B);
+                TIMSK1 |= (1 << OCIE1B);
+            }
+            break;
+#endif
+#ifdef TCCR2A
+        case TIMER_2:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                OCR2A = (uint8_t)value;
+                TIFR2 = (1 << OCF2A);
+                TIMSK2 |= (1 << OCIE2A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                OCR2B = (uint8_t)value;
+                TIFR2 = (1 << OCF2B);
+                TIMSK2 |= (1 << OCIE2B);
+            }
+            break;
+#endif
+        default:
+            return;
+    }
+}
+
+void timer_clearCompare(Timer *timer, const TimerEvent event) {
+    switch (timer->index) {
+#ifdef TCCR0A
+        case TIMER_0:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                TIMSK0 &= ~(1 << OCIE0A);
+                TIFR0 = (1 << OCF0A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                TIMSK0 &= ~(1 << OCIE0B);
+                TIFR0 = (1 << OCF0B);
+            }
+            break;
+#endif
+#ifdef TCCR1A
+        case TIMER_1:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                TIMSK1 &= ~(1 << OCIE1A);
+                TIFR1 = (1 << OCF1A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                TIMSK1 &= ~(1 << OCIE1B);
+                TIFR1 = (1 << OCF1B);
+            }
+            break;
+#endif
+#ifdef TCCR2A
+        case TIMER_2:
+            if (TIMER_EVENT_COMPARE_A == event) {
+                TIMSK2 &= ~(1 << OCIE2A);
+                TIFR2 = (1 << OCF2A);
+            } else if (TIMER_EVENT_COMPARE_B == event) {
+                TIMSK2 &= ~(1 << OCIE2B);
+                TIFR2 = (1 << OCF2B);
+            }
+            break;
+#endif
+        default:
+            return;
+    }
+}
+
 void timer_setPwmDuty(Timer *timer, uint8_t duty) {
     uint32_t ocr;
 
@@ -580,3 +726,42 @@ uint16_t timer_get(Timer *timer) {
             return UINT16_MAX;
     }
 }
+
+uint32_t timer_getStamp(Timer *timer) {
+    uint32_t stamp = 0;
+
+    switch (timer->index) {
+#ifdef TCCR1A
+        case TIMER_1: {
+            uint8_t sreg = SREG;
+            cli();
+            stamp = extend(timer->epoch, TCNT1);
+            SREG = sreg;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+    return stamp;
+}
+
+//NOTE: The stamp of the last captured edge in a free running meter, the
+//      base the next result is measured from
+uint32_t timer_getCapture(Timer *timer) {
+    uint8_t sreg = SREG;
+    uint32_t capture;
+
+    cli();
+    capture = timer->capture;
+    SREG = sreg;
+    return capture;
+}
+
+void timer_setCapture(Timer *timer, const uint32_t capture) {
+    uint8_t sreg = SREG;
+
+    cli();
+    timer->capture = capture;
+    SREG = sreg;
+}
@@ -40,19 +40,33 @@ typedef enum TIMER_EVENT {
     TIMER_EVENT_OVERFLOW
 } TimerEvent;
 
+typedef enum TIMER_METER_MODE {
+    TIMER_METER_MODE_RESET,
+    TIMER_METER_MODE_FREE_RUNNING
+} TimerMeterMode;
+
 typedef void (*TimerHandler)(TimerEvent event);
-typedef void (*TimerResultHandler)(uint16_t result);
+typedef void (*TimerResultHandler)(uint32_t result);
 
 typedef struct {
     TimerIndex index;
     TimerHandler handler;
     TimerResultHandler resultHandler;
     uint8_t clockSelect;
+    TimerMeterMode meterMode;
+    uint16_t epoch;
+    uint32_t capture;
 } Timer;
 
 bool timer_configSimple(Timer *timer, const TimerIndex index,
                         const uint32_t freq, const TimerHandler handler,
                         const TimerOutput out);
+bool timer_calcSimple(const TimerIndex index, const uint32_t freq,
+                      const TimerOutput out, uint8_t *clockSelect,
+                      uint16_t *ocr);
+void timer_loadSimple(Timer *timer, const TimerIndex index,
+                      const uint8_t clockSelect, const uint16_t ocr,
+                      const TimerHandler handler, const TimerOutput out);
 bool timer_configPwm(Timer *timer, const TimerIndex index, const uint32_t freq,
                      const TimerPwmMode mode, const uint16_t duty,
                      const TimerHandler handler, const TimerOutput out);
@@ -60,11 +74,18 @@ void timer_configCounter(Timer *timer, const TimerIndex index,
                          const TimerInput input, const uint16_t top,
                          const TimerHandler handler, const TimerOutput out);
 bool timer_configMeter(Timer *timer, const TimerIndex index,
-                       const uint32_t freq, const TimerHandler handler,
+                       const uint32_t freq, const TimerMeterMode mode,
+                       const TimerHandler handler,
                        const TimerResultHandler resultHandler);
 void timer_run(Timer *timer, uint16_t start);
 void timer_stop(Timer *timer);
+void timer_setCompare(Timer *timer, const TimerEvent event,
+                      const uint16_t value);
+void timer_clearCompare(Timer *timer, const TimerEvent event);
 void timer_setPwmDuty(Timer *timer, const uint8_t duty);
 uint16_t timer_get(Timer *timer);
+uint32_t timer_getStamp(Timer *timer);
+uint32_t timer_getCapture(Timer *timer);
+void timer_setCapture(Timer *timer, const uint32_t capture);
 
 #endif /* TIMER_H_ */
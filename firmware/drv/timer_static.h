@@ -0,0 +1,190 @@
+#ifndef TIMER_STATIC_H_
+#define TIMER_STATIC_H_
+
+#include "timer.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Statically bound timer driver.                                           *
+ *                                                                          *
+ * The timer with the TIMER_STATIC_n flag has no ISR in timer.c. Its owner  *
+ * binds the handlers with one of the TIMER_STATIC_*_ISR macros, so the     *
+ * vectors call the handlers directly and can inline them. The clock       *
+ * select and the compare values are worked out from constant frequencies  *
+ * at compile time.                                                         *
+ ****************************************************************************/
+
+#define TIMER_STATIC_OCR(freq, prescale, half) \
+        (F_CPU / ((half) * (prescale) * (freq)) - 1)
+
+#define TIMER_STATIC_FITS(freq, prescale, half, max) \
+        (TIMER_STATIC_OCR(freq, prescale, half) <= (max))
+
+#define TIMER_STATIC_CS01(freq, half, max) \
+        (TIMER_STATIC_FITS(freq, 1, half, max)    ? 1 : \
+         TIMER_STATIC_FITS(freq, 8, half, max)    ? 2 : \
+         TIMER_STATIC_FITS(freq, 64, half, max)   ? 3 : \
+         TIMER_STATIC_FITS(freq, 256, half, max)  ? 4 : \
+         TIMER_STATIC_FITS(freq, 1024, half, max) ? 5 : 0)
+
+#define TIMER_STATIC_PRESCALE01(cs) \
+        ((1 == (cs)) ? 1 : (2 == (cs)) ? 8 : (3 == (cs)) ? 64 : \
+         (4 == (cs)) ? 256 : 1024)
+
+#define TIMER_STATIC_CS2(freq, half, max) \
+        (TIMER_STATIC_FITS(freq, 1, half, max)    ? 1 : \
+         TIMER_STATIC_FITS(freq, 8, half, max)    ? 2 : \
+         TIMER_STATIC_FITS(freq, 32, half, max)   ? 3 : \
+         TIMER_STATIC_FITS(freq, 64, half, max)   ? 4 : \
+         TIMER_STATIC_FITS(freq, 128, half, max)  ? 5 : \
+         TIMER_STATIC_FITS(freq, 256, half, max)  ? 6 : \
+         TIMER_STATIC_FITS(freq, 1024, half, max) ? 7 : 0)
+
+#define TIMER_STATIC_PRESCALE2(cs) \
+        ((1 == (cs)) ? 1 : (2 == (cs)) ? 8 : (3 == (cs)) ? 32 : \
+         (4 == (cs)) ? 64 : (5 == (cs)) ? 128 : (6 == (cs)) ? 256 : 1024)
+
+//NOTE: A meter counts at the exact frequency, so there is no compare value
+//      and only a divider with a zero remainder is accepted
+#define TIMER_STATIC_METER_CS(freq)  TIMER_STATIC_CS01(freq, 1, 0)
+
+#define timer_staticSetCompare(n, event, value) \
+    do { \
+        if (TIMER_EVENT_COMPARE_A == (event)) { \
+            OCR##n##A = (value); \
+            TIFR##n = (1 << OCF##n##A); \
+            TIMSK##n |= (1 << OCIE##n##A); \
+        } else if (TIMER_EVENT_COMPARE_B == (event)) { \
+            OCR##n##B = (value); \
+            TIFR##n = (1 << OCF##n##B); \
+            TIMSK##n |= (1 << OCIE##n##B); \
+        } \
+    } while (0)
+
+#define timer_staticClearCompare(n, event) \
+    do { \
+        if (TIMER_EVENT_COMPARE_A == (event)) { \
+            TIMSK##n &= ~(1 << OCIE##n##A); \
+            TIFR##n = (1 << OCF##n##A); \
+        } else if (TIMER_EVENT_COMPARE_B == (event)) { \
+            TIMSK##n &= ~(1 << OCIE##n##B); \
+            TIFR##n = (1 << OCF##n##B); \
+        } \
+    } while (0)
+
+#define timer_staticGet(n)  (TCNT##n)
+
+#define timer_staticRun(n, cs) \
+    do { \
+        TCNT##n = 0; \
+        TCCR##n##B |= (((cs) & 0x7) << CS##n##0); \
+    } while (0)
+
+/****************************************************************************
+ * Timer 1 meter                                                            *
+ ****************************************************************************/
+
+#ifdef TCCR1A
+static inline uint32_t timer_staticExtend1(uint16_t epoch,
+                                           const uint16_t count) {
+    if ((TIFR1 & (1 << TOV1)) && (count < 0x8000)) {
+        epoch++;
+    }
+    return ((uint32_t)epoch << 16) | count;
+}
+
+static inline uint32_t timer_staticGetStamp1(Timer *timer) {
+    uint8_t sreg = SREG;
+    uint32_t stamp;
+
+    cli();
+    stamp = timer_staticExtend1(timer->epoch, TCNT1);
+    SREG = sreg;
+    return stamp;
+}
+
+static inline uint32_t timer_staticGetCapture1(Timer *timer) {
+    uint8_t sreg = SREG;
+    uint32_t capture;
+
+    cli();
+    capture = timer->capture;
+    SREG = sreg;
+    return capture;
+}
+
+static inline void timer_staticSetCapture1(Timer *timer,
+                                           const uint32_t capture) {
+    uint8_t sreg = SREG;
+
+    cli();
+    timer->capture = capture;
+    SREG = sreg;
+}
+
+static inline void timer_staticConfigMeter1(Timer *timer,
+                                            const TimerMeterMode mode) {
+    timer->index = TIMER_1;
+    timer->handler = NULL;
+    timer->resultHandler = NULL;
+    timer->meterMode = mode;
+    timer->epoch = 0;
+    timer->capture = 0;
+    TIMSK1 = (1 << ICIE1) | (1 << TOIE1);
+    TCCR1A = 0;
+    TCCR1B = (1 << ICNC1) | (0 << ICES1);
+    TCCR1C = 0;
+}
+
+#define TIMER_STATIC_METER_1_ISR(timer, mode, handler, resultHandler) \
+    ISR(TIMER1_COMPA_vect) { \
+        handler(TIMER_EVENT_COMPARE_A); \
+    } \
+    ISR(TIMER1_COMPB_vect) { \
+        handler(TIMER_EVENT_COMPARE_B); \
+    } \
+    ISR(TIMER1_CAPT_vect) { \
+        uint16_t capture = ICR1; \
+        uint32_t result = capture; \
+        if (TIMER_METER_MODE_FREE_RUNNING == (mode)) { \
+            uint32_t stamp = timer_staticExtend1((timer).epoch, capture); \
+            result = stamp - (timer).capture; \
+            (timer).capture = stamp; \
+        } else { \
+            TCNT1 = 0; \
+        } \
+        resultHandler(result); \
+    } \
+    ISR(TIMER1_OVF_vect) { \
+        (timer).epoch++; \
+        handler(TIMER_EVENT_OVERFLOW); \
+    }
+#endif
+
+/****************************************************************************
+ * Timer 2 square wave output                                               *
+ ****************************************************************************/
+
+#ifdef TCCR2A
+#define TIMER_STATIC_WGM2_CTC_OCR  2
+
+#define TIMER_STATIC_OUTPUT_CS2(freq)  TIMER_STATIC_CS2(freq, 2, UINT8_MAX)
+#define TIMER_STATIC_OUTPUT_OCR2(freq) \
+        TIMER_STATIC_OCR(freq, TIMER_STATIC_PRESCALE2(TIMER_STATIC_OUTPUT_CS2(freq)), 2)
+
+//NOTE: With no handler the output runs in hardware only, so no interrupt
+//      is enabled at all
+static inline void timer_staticConfigOutput2(const uint8_t ocr,
+                                             const TimerOutput out) {
+    OCR2A = ocr;
+    TIMSK2 = 0;
+    TCCR2A = ((out & 0xF) << COM2B0) | ((TIMER_STATIC_WGM2_CTC_OCR & 0x3) << WGM20);
+    TCCR2B = (0 << FOC2A) | (0 << FOC2B) | (0 << WGM22);
+}
+#endif
+
+#endif /* TIMER_STATIC_H_ */
@@ -1,6 +1,8 @@
 #include "usart.h"
+#include "event.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <stddef.h>
 #include <limits.h>
 
@@ -27,6 +29,8 @@ static Usart *usart0;
 static Usart *usart1;
 #endif
 
+#define USART_DIVISOR_MAX  4096
+
 /****************************************************************************
  * Public types/enumerations/variables                                      *
  ****************************************************************************/
@@ -60,6 +64,8 @@ ISR(USART_RX_vect) {
 #else
 ISR(USART0_RX_vect) {
 #endif
+    LATENCY_ENTER(entry);
+
     if (usart0 && !FRAME_ERROR_0 && !PARITY_ERROR_0 && !DATA_OVERRUN_0) {
         if (usart0->rxBufferCount < USART_BUFFER_SIZE) {
             usart0->rxBuffer[usart0->rxBufferIndexWrite++] = *usart0->regData;
@@ -67,10 +73,27 @@ ISR(USART0_RX_vect) {
                 usart0->rxBufferIndexWrite = 0;
             }
             usart0->rxBufferCount++;
+            event_post(EVENT_BYTE);
+        } else {
+            (void)UDR0;
+            if (usart0->rxOverruns < UINT16_MAX) {
+                usart0->rxOverruns++;
+            }
         }
     } else {
+        if (usart0) {
+            if (DATA_OVERRUN_0 && (usart0->rxOverruns < UINT16_MAX)) {
+                usart0->rxOverruns++;
+            }
+            if ((FRAME_ERROR_0 || PARITY_ERROR_0) && (usart0->rxErrors < UINT16_MAX)) {
+                usart0->rxErrors++;
+            }
+        }
         (void)UDR0;
     }
+    if (usart0) {
+        LATENCY_EXIT(&usart0->rxLatency, entry);
+    }
 }
 
 #ifndef UCSR1A
@@ -78,6 +101,8 @@ ISR(USART_TX_vect) {
 #else
 ISR(USART0_TX_vect) {
 #endif
+    LATENCY_ENTER(entry);
+
     if (usart0) {
         if (usart0->txBufferCount > 0)
         {
@@ -85,14 +110,19 @@ ISR(USART0_TX_vect) {
             if (USART_BUFFER_SIZE == usart0->txBufferIndexRead) {
                 usart0->txBufferIndexRead = 0;
             }
-            usart0->txBufferCount--;
+            if (0 == --usart0->txBufferCount) {
+                event_post(EVENT_SENT);
+            }
         }
+        LATENCY_EXIT(&usart0->txLatency, entry);
     }
 }
 #endif
 
 #ifdef UCSR1A
 ISR(USART1_RX_vect) {
+    LATENCY_ENTER(entry);
+
     if (usart1 && !FRAME_ERROR_1 && !PARITY_ERROR_1 && !DATA_OVERRUN_1)
     {
         if (usart1->rxBufferCount < USART_BUFFER_SIZE) {
@@ -103,13 +133,32 @@ ISR(USART1_RX_vect) {
             ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
                 usart1->rxBufferCount++;
             }
+            event_post(EVENT_BYTE);
+        } else {
+            (void)UDR1;
+            if (usart1->rxOverruns < UINT16_MAX) {
+                usart1->rxOverruns++;
+            }
         }
     } else {
+        if (usart1) {
+            if (DATA_OVERRUN_1 && (usart1->rxOverruns < UINT16_MAX)) {
+                usart1->rxOverruns++;
+            }
+            if ((FRAME_ERROR_1 || PARITY_ERROR_1) && (usart1->rxErrors < UINT16_MAX)) {
+                usart1->rxErrors++;
+            }
+        }
         (void)UDR1;
     }
+    if (usart1) {
+        LATENCY_EXIT(&usart1->rxLatency, entry);
+    }
 }
 
 ISR(USART1_TX_vect) {
+    LATENCY_ENTER(entry);
+
     if (usart1) {
         if (usart1->txBufferCount > 0)
         {
@@ -120,7 +169,11 @@ ISR(USART1_TX_vect) {
             ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
                 usart1->txBufferCount--;
             }
+            if (0 == usart1->txBufferCount) {
+                event_post(EVENT_SENT);
+            }
         }
+        LATENCY_EXIT(&usart1->txLatency, entry);
     }
 }
 #endif
@@ -130,7 +183,12 @@ ISR(USART1_TX_vect) {
  ****************************************************************************/
 
 bool usart_init(Usart *usart, const UsartIndex index, const uint32_t baudrate) {
-    //TODO: Use setbaud.h
+    uint16_t divisor;
+    bool doubleSpeed;
+
+    if (!usart_calcBaudrate(baudrate, &divisor, &doubleSpeed)) {
+        return false;
+    }
     usart->index = index;
     usart->rxBufferIndexRead = 0;
     usart->rxBufferIndexWrite = 0;
@@ -138,23 +196,25 @@ bool usart_init(Usart *usart, const UsartIndex index, const uint32_t baudrate) {
     usart->txBufferIndexRead = 0;
     usart->txBufferIndexWrite = 0;
     usart->txBufferCount = 0;
+    usart->rxOverruns = 0;
+    usart->rxErrors = 0;
+#ifdef LATENCY_STATS
+    latency_reset(&usart->rxLatency);
+    latency_reset(&usart->txLatency);
+#endif
     switch (index) {
         #ifdef UCSR0A
         case USART_0:
-            UCSR0A = 0;
             UCSR0B = (1 << RXCIE0) | (1 << TXCIE0) | (1 << RXEN0) | (1 << TXEN0);
             UCSR0C = (1 << UCSZ00) | (1 << UCSZ01);
-            UBRR0 = F_CPU / (16 * baudrate) - 1;
             usart->regData = &UDR0;
             usart0 = usart;
             break;
         #endif
         #ifdef UCSR1A
         case USART_1:
-            UCSR1A = 0;
             UCSR1B = (1 << RXCIE1) | (1 << TXCIE1) | (1 << RXEN1) | (1 << TXEN1);
             UCSR1C = (1 << UCSZ10) | (1 << UCSZ11);
-            UBRR1 = F_CPU / (16 * baudrate) - 1;
             usart->regData = &UDR1;
             usart1 = usart;
             break;
@@ -162,9 +222,53 @@ bool usart_init(Usart *usart, const UsartIndex index, const uint32_t baudrate) {
         default:
             return false;
     }
+    usart_loadBaudrate(usart, divisor, doubleSpeed);
     return true;
 }
 
+//NOTE: The same choice as util/setbaud.h makes at build time, the divisor is
+//      rounded to the nearest and the double speed is only taken when the
+//      normal one misses the rate by more than USART_BAUD_TOLERANCE
+bool usart_calcBaudrate(const uint32_t baudrate, uint16_t *divisor,
+                        bool *doubleSpeed) {
+    for (uint8_t samples = 16; samples >= 8; samples -= 8) {
+        uint32_t clocks = samples * baudrate;
+        uint32_t ticks = (F_CPU + clocks / 2) / clocks;
+        if ((ticks > 0) && (ticks <= USART_DIVISOR_MAX)) {
+            uint32_t actual = F_CPU / (samples * ticks);
+            uint32_t error = (actual > baudrate) ? (actual - baudrate) : (baudrate - actual);
+            if (error * 100 <= baudrate * USART_BAUD_TOLERANCE) {
+                *divisor = ticks - 1;
+                *doubleSpeed = (8 == samples);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//NOTE: The rate changes under a byte being moved, so it is loaded with the
+//      transmitter idle
+void usart_loadBaudrate(Usart *usart, const uint16_t divisor,
+                        const bool doubleSpeed) {
+    switch (usart->index) {
+        #ifdef UCSR0A
+        case USART_0:
+            UCSR0A = doubleSpeed ? (1 << U2X0) : 0;
+            UBRR0 = divisor;
+            break;
+        #endif
+        #ifdef UCSR1A
+        case USART_1:
+            UCSR1A = doubleSpeed ? (1 << U2X1) : 0;
+            UBRR1 = divisor;
+            break;
+        #endif
+        default:
+            break;
+    }
+}
+
 void usart_putchar(Usart *usart, const uint8_t data) {
     while (usart->txBufferCount >= USART_BUFFER_SIZE);
     if ((usart->txBufferCount > 0) || !dataRegisterEmpty(usart->index)) {
@@ -198,3 +302,10 @@ const uint8_t usart_getchar(Usart *usart) {
 void usart_flush(Usart *usart) {
     while (usart->txBufferCount != 0);
 }
+
+void usart_getErrors(Usart *usart, uint16_t *overruns, uint16_t *errors) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *overruns = usart->rxOverruns;
+        *errors = usart->rxErrors;
+    }
+}
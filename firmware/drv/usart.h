@@ -1,10 +1,14 @@
 #ifndef USART_H_
 #define USART_H_
 
+#include "latency.h"
 #include <stdint.h>
 #include <stdbool.h>
 
-#define USART_BUFFER_SIZE  10
+#define USART_BUFFER_SIZE  32
+
+//NOTE: Largest rate error accepted for a divisor, in percent
+#define USART_BAUD_TOLERANCE  2
 
 typedef enum USART {
   USART_0 = 0,
@@ -20,12 +24,21 @@ typedef struct {
     uint8_t txBuffer[USART_BUFFER_SIZE];
     uint8_t txBufferIndexRead, txBufferIndexWrite;
     volatile uint8_t txBufferCount;
+    volatile uint16_t rxOverruns, rxErrors;
+#ifdef LATENCY_STATS
+    Latency rxLatency, txLatency;
+#endif
 } Usart;
 
 bool usart_init(Usart *usart, const UsartIndex index, const uint32_t baudrate);
+bool usart_calcBaudrate(const uint32_t baudrate, uint16_t *divisor,
+                        bool *doubleSpeed);
+void usart_loadBaudrate(Usart *usart, const uint16_t divisor,
+                        const bool doubleSpeed);
 void usart_putchar(Usart *usart, const uint8_t data);
 void usart_putstr(Usart *usart, const char *str);
 const uint8_t usart_getchar(Usart *usart);
+void usart_getErrors(Usart *usart, uint16_t *overruns, uint16_t *errors);
 void usart_flush(Usart *usart);
 
 #endif /* USART_H_ */
@@ -0,0 +1,203 @@
+#include "vtimer.h"
+#include "timer.h"
+#include "event.h"
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+#define VTIMER_COUNTER_RANGE  (UINT8_MAX + 1)
+
+static Timer timer0;
+static volatile uint8_t epoch;
+static VTimer *head;
+static volatile bool distant;
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+static void attach(VTimer *vtimer, const uint16_t now) {
+    VTimer *prev = NULL;
+    VTimer *node = head;
+    int16_t left = vtimer->deadline - now;
+
+    while ((NULL != node) && ((int16_t)(node->deadline - now) <= left)) {
+        prev = node;
+        node = node->next;
+    }
+    vtimer->next = node;
+    vtimer->pending = true;
+    if (NULL == prev) {
+        head = vtimer;
+    } else {
+        prev->next = vtimer;
+    }
+}
+
+static void detach(VTimer *vtimer) {
+    VTimer *prev = NULL;
+    VTimer *node = head;
+
+    while ((NULL != node) && (vtimer != node)) {
+        prev = node;
+        node = node->next;
+    }
+    if (NULL != node) {
+        if (NULL == prev) {
+            head = vtimer->next;
+        } else {
+            prev->next = vtimer->next;
+        }
+    }
+    vtimer->next = NULL;
+    vtimer->pending = false;
+}
+
+//NOTE: Only the nearest deadline is loaded into the compare unit. One due
+//      too soon for the compare to catch is posted at once, and one beyond
+//      the 8-bit counter range is left to the overflow.
+static void reprogram(void) {
+    distant = false;
+    if (NULL != head) {
+        int16_t left = head->deadline - vtimer_get();
+
+        if (left >= VTIMER_COUNTER_RANGE) {
+            distant = true;
+        } else {
+            if (left > 1) {
+                timer_setCompare(&timer0, TIMER_EVENT_COMPARE_A,
+                                 (uint8_t)head->deadline);
+                if ((int16_t)(head->deadline - vtimer_get()) > 1) {
+                    return;
+                }
+            }
+            event_post(EVENT_TIMER);
+        }
+    }
+    timer_clearCompare(&timer0, TIMER_EVENT_COMPARE_A);
+}
+
+//NOTE: A periodic timer that has fallen more than a period behind skips
+//      the missed expiries, so a pass never handles one timer twice
+static VTimer *take(void) {
+    VTimer *due = head;
+    uint16_t now = vtimer_get();
+
+    if ((NULL == due) || ((int16_t)(due->deadline - now) > 1)) {
+        reprogram();
+        return NULL;
+    }
+    detach(due);
+    if (due->period > 0) {
+        due->deadline += due->period;
+        if ((int16_t)(due->deadline - now) <= 1) {
+            due->deadline = now + due->period;
+        }
+        attach(due, now);
+    }
+    return due;
+}
+
+//NOTE: The ISR only posts the expiry, the handlers run from the main loop
+static void tick(TimerEvent event) {
+    if (TIMER_EVENT_OVERFLOW == event) {
+        epoch++;
+        if (distant) {
+            event_post(EVENT_TIMER);
+        }
+    } else {
+        timer_clearCompare(&timer0, TIMER_EVENT_COMPARE_A);
+        event_post(EVENT_TIMER);
+    }
+}
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+bool vtimer_init(void) {
+    uint8_t clockSelect;
+
+    if (!timer_calcSimple(TIMER_0, VTIMER_FREQUENCY_HZ, TIMER_OUTPUT_NONE,
+                          &clockSelect, NULL)) {
+        return false;
+    }
+    timer_loadSimple(&timer0, TIMER_0, clockSelect, 0, tick,
+                     TIMER_OUTPUT_NONE);
+    timer_run(&timer0, 0);
+    return true;
+}
+
+bool vtimer_configSimple(VTimer *vtimer, const uint32_t freq,
+                         const VTimerHandler handler) {
+    uint32_t period = VTIMER_FREQUENCY_HZ / freq;
+
+    if ((0 == period) || (period > INT16_MAX)) {
+        return false;
+    }
+    vtimer_stop(vtimer);
+    vtimer->handler = handler;
+    vtimer->period = period;
+    return true;
+}
+
+void vtimer_run(VTimer *vtimer, uint16_t start) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint16_t now = vtimer_get();
+        if (vtimer->pending) {
+            detach(vtimer);
+        }
+        vtimer->deadline = now + vtimer->period - start;
+        attach(vtimer, now);
+        reprogram();
+    }
+}
+
+void vtimer_stop(VTimer *vtimer) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (vtimer->pending) {
+            detach(vtimer);
+            reprogram();
+        }
+    }
+}
+
+//NOTE: Each due timer is taken off the list with the interrupts disabled
+//      and its handler runs with them enabled, so a handler may restart or
+//      stop any timer
+void vtimer_work(void) {
+    VTimer *due;
+
+    do {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            due = take();
+        }
+        if ((NULL != due) && due->handler) {
+            due->handler(due);
+        }
+    } while (NULL != due);
+}
+
+//NOTE: An overflow still pending belongs to the time only when the counter
+//      was read after the wrap
+uint16_t vtimer_get(void) {
+    uint16_t result;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t count = TCNT0;
+        uint8_t high = epoch;
+        if ((TIFR0 & (1 << TOV0)) && (count < (VTIMER_COUNTER_RANGE / 2))) {
+            high++;
+        }
+        result = ((uint16_t)high << 8) | count;
+    }
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef VTIMER_H_
+#define VTIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VTIMER_FREQUENCY_HZ  (F_CPU / 256)
+
+typedef struct _VTimer VTimer;
+
+//NOTE: The Timer0 ISR posts EVENT_TIMER, a handler runs from vtimer_work()
+//      in the main loop with the interrupts enabled
+typedef void (*VTimerHandler)(VTimer *vtimer);
+
+struct _VTimer {
+    VTimer *next;
+    VTimerHandler handler;
+    uint16_t deadline;
+    uint16_t period;
+    bool pending;
+};
+
+bool vtimer_init(void);
+bool vtimer_configSimple(VTimer *vtimer, const uint32_t freq,
+                         const VTimerHandler handler);
+void vtimer_run(VTimer *vtimer, uint16_t start);
+void vtimer_stop(VTimer *vtimer);
+void vtimer_work(void);
+uint16_t vtimer_get(void);
+
+#endif /* VTIMER_H_ */
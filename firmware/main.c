@@ -1,4 +1,9 @@
 #include "timer.h"
+#include "vtimer.h"
+#include "event.h"
+#ifdef TIMER_STATIC_2
+#include "timer_static.h"
+#endif
 #include "cdi.h"
 #include "remote.h"
 #include <avr/io.h>
@@ -9,6 +14,35 @@
 
 #define WD_RESET_FREQ_HZ  126
 
+#ifdef LATENCY_STATS
+//NOTE: Timer2 counts the CPU cycles for the latency statistics, so the pin
+//      is toggled from a software timer in the main loop instead
+static VTimer watchdogTimer;
+
+static void toggle(VTimer *vtimer)
+{
+    PIND = (1 << PIND3);
+}
+
+static void watchdog_init(void)
+{
+    DDRD |= (1 << DDD3);
+    if (vtimer_configSimple(&watchdogTimer, WD_RESET_FREQ_HZ, toggle)) {
+        vtimer_run(&watchdogTimer, 0);
+    }
+}
+#elif defined(TIMER_STATIC_2)
+#if 0 == TIMER_STATIC_OUTPUT_CS2(WD_RESET_FREQ_HZ)
+#error "WD_RESET_FREQ_HZ is out of the Timer2 range"
+#endif
+
+static void watchdog_init(void)
+{
+    DDRD |= (1 << DDD3);
+    timer_staticConfigOutput2(TIMER_STATIC_OUTPUT_OCR2(WD_RESET_FREQ_HZ), TIMER_OUTPUT_TOGGLE_B);
+    timer_staticRun(2, TIMER_STATIC_OUTPUT_CS2(WD_RESET_FREQ_HZ));
+}
+#else
 static Timer timer2;
 
 static void watchdog_init(void)
@@ -17,15 +51,29 @@ static void watchdog_init(void)
     timer_configSimple(&timer2, TIMER_2, WD_RESET_FREQ_HZ, NULL, TIMER_OUTPUT_TOGGLE_B);
     timer_run(&timer2, 0);
 }
+#endif
 
 int main(void)
 {
     sei();
+    event_init();
+    vtimer_init();
     watchdog_init();
     cdi_init();
     remote_init();
+    //NOTE: The core idles between the events, so a handler only runs for
+    //      what an interrupt has posted since its last pass
     while (true) {
-        remote_work();
+        uint8_t events = event_wait();
+        if (events & EVENT_TIMER) {
+            vtimer_work();
+        }
+        if (events & (EVENT_EDGE | EVENT_TABLE | EVENT_STORE)) {
+            cdi_work(events);
+        }
+        if (events & (EVENT_BYTE | EVENT_SENT | EVENT_LINK)) {
+            remote_work();
+        }
     }
     return 0;
 }
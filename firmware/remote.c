@@ -1,17 +1,60 @@
 #include "remote.h"
 #include "usart.h"
 #include "cdi.h"
+#include "vtimer.h"
+#include "event.h"
+#include "trace.h"
 #include <avr/io.h>
 #include <util/crc16.h>
+#include <util/atomic.h>
+
+#define BAUD  REMOTE_BAUDRATE
+#include <util/setbaud.h>
 
 /****************************************************************************
  * Private types/enumerations/variables                                     *
  ****************************************************************************/
 
+#if CDI_TIMING_RECORD_SLOTS > REMOTE_RECORD_SLOTS_MAX
+#error "CDI_TIMING_RECORD_SLOTS does not fit the record packet"
+#endif
+#if CDI_VALUE_MAX * CDI_TIMING_STEPS > REMOTE_RECORD_TIMING_MASK
+#error "The timing range does not fit the record packet"
+#endif
+//NOTE: The main loop may not take a byte until the whole window is in, and
+//      the replies to it must not wait for room in the transmit buffer
+#if REMOTE_FRAME_WINDOW * REMOTE_FRAME_LEN_MAX > USART_BUFFER_SIZE
+#error "REMOTE_FRAME_WINDOW does not fit the receive and transmit buffers"
+#endif
+#if REMOTE_LINK_TIMEOUT_CHECKS > UINT8_MAX
+#error "REMOTE_LINK_TIMEOUT_CHECKS does not fit the idle counter"
+#endif
+#if REMOTE_LINK_TIMEOUT_MS <= REMOTE_LINK_SETTLE_MS + REMOTE_LINK_REPLY_MS
+#error "The link would drop back on a single lost frame"
+#endif
+#if REMOTE_FRAME_LEN_MAX > USART_BUFFER_SIZE
+#error "A reply frame does not fit the transmit buffer"
+#endif
+
 static uint8_t receivedPartIndex;
+static bool framed;
+static uint8_t frameLength, frameSeq;
+static uint16_t frameCrc;
 static RemoteControlPacket controlPacket;
 static RemoteReplyPacket replyPacket;
 static Usart usart0;
+static VTimer linkTimer;
+static uint16_t linkDivisor;
+static bool linkDoubleSpeed, linkFast;
+static volatile uint8_t linkSwitch, linkIdle;
+static uint16_t crcErrors;
+static uint8_t tableNext, tableLeft;
+static volatile uint8_t tableIdle;
+static uint16_t tableCrc;
+static uint32_t tableRequest;
+static uint8_t burstCmd, burstNext, burstLeft;
+static uint16_t burstCrc;
+static Latency latencyTaken;
 
 /****************************************************************************
  * Public types/enumerations/variables                                      *
@@ -21,42 +64,297 @@ static Usart usart0;
  * Private functions                                                        *
  ****************************************************************************/
 
-static void proceed(void) {
-    uint8_t crc = 0;
+static bool takeLatency(const uint8_t slot, uint16_t *min, uint16_t *average,
+                        uint16_t *max) {
+#ifdef LATENCY_STATS
+    Latency latency;
+
+    switch (slot) {
+        case REMOTE_LATENCY_RX:
+            latency_take(&usart0.rxLatency, &latency);
+            break;
+        case REMOTE_LATENCY_TX:
+            latency_take(&usart0.txLatency, &latency);
+            break;
+        case REMOTE_LATENCY_PLAN:
+            return cdi_takeLatency(CDI_LATENCY_PLAN, min, average, max);
+        default:
+            return cdi_takeLatency(slot, min, average, max);
+    }
+    *min = latency.min;
+    *average = latency.average;
+    *max = latency.max;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static uint16_t getStat(const uint8_t index) {
+    uint16_t rejected, resyncs, overruns, errors;
+
+    switch (index) {
+        case REMOTE_STATS_TEETH:
+            return cdi_getStat(CDI_STAT_TEETH);
+        case REMOTE_STATS_SPARKS:
+            return cdi_getStat(CDI_STAT_SPARKS);
+        case REMOTE_STATS_SKIPPED:
+            return cdi_getStat(CDI_STAT_SKIPPED);
+        case REMOTE_STATS_RESYNCS:
+            cdi_getFaults(&rejected, &resyncs);
+            return resyncs;
+        case REMOTE_STATS_STALLS:
+            return cdi_getStat(CDI_STAT_STALLS);
+        case REMOTE_STATS_OVERRUNS:
+            usart_getErrors(&usart0, &overruns, &errors);
+            return overruns;
+        case REMOTE_STATS_FRAMING:
+            usart_getErrors(&usart0, &overruns, &errors);
+            return errors;
+        case REMOTE_STATS_CRC:
+            return crcErrors;
+        default:
+            return 0;
+    }
+}
+
+static bool validRange(const uint8_t first, const uint8_t count) {
+    return (count > 0) && (first < CDI_TIMING_RECORD_SLOTS) &&
+            (count <= CDI_TIMING_RECORD_SLOTS - first);
+}
+
+static void getRecord(const uint8_t slot) {
+    CdiTimingRecord *record = getTimingRecord(slot);
+    uint16_t rps = (record->rpm + 30) / 60;
+
+    replyPacket.value8_0 = slot;
+    replyPacket.value8_1 = (rps > UINT8_MAX) ? UINT8_MAX : rps;
+    replyPacket.value8_2 = (record->timing + CDI_TIMING_STEPS / 2) / CDI_TIMING_STEPS;
+    replyPacket.value8_3 = 0;
+}
+
+static void getBreakpoint(const uint8_t slot) {
+    CdiTimingRecord *record = getTimingRecord(slot);
+
+    replyPacket.value16_0 = record->rpm;
+    replyPacket.value16_1 = ((uint16_t)slot << REMOTE_RECORD_SLOT_SHIFT) |
+            record->timing;
+}
+
+static bool setBreakpoint(void) {
+    uint8_t slot = controlPacket.value16_1 >> REMOTE_RECORD_SLOT_SHIFT;
+    uint16_t timing = controlPacket.value16_1 & REMOTE_RECORD_TIMING_MASK;
 
-    //TODO: Use crc16.h
-    for (uint8_t i = 0; i < REMOTE_CONTROL_PACKET_PART_CRC; i++) {
-        crc += controlPacket.bytes[i];
+    if ((slot < CDI_TIMING_RECORD_SLOTS) &&
+            (timing <= CDI_VALUE_MAX * CDI_TIMING_STEPS)) {
+        cdi_setTimingRecord(slot, controlPacket.value16_0, timing);
+        return true;
     }
-    if (crc == controlPacket.crc) {
+    return false;
+}
+
+static uint16_t crcRecord(uint16_t crc, const uint8_t *value) {
+    for (uint8_t i = 0; i < sizeof(uint32_t); i++) {
+        crc = _crc_ccitt_update(crc, value[i]);
+    }
+    return crc;
+}
+
+//NOTE: The records taken so far went to the shadow table, they are dropped
+//      with every other edit not committed yet
+static void dropTable(void) {
+    tableLeft = 0;
+    cdi_revert();
+}
+
+static uint16_t send(uint16_t crc, const uint8_t byte) {
+    usart_putchar(&usart0, byte);
+    return _crc_ccitt_update(crc, byte);
+}
+
+//NOTE: A reply goes out in the framing of the request it answers
+static void reply(void) {
+    if (framed) {
+        uint16_t crc = REMOTE_CRC_INIT;
+        crc = send(crc, REMOTE_FRAME_HEADER);
+        crc = send(crc, REMOTE_FRAME_PAYLOAD_MAX);
+        crc = send(crc, frameSeq);
+        for (uint8_t i = REMOTE_REPLY_PACKET_PART_CMD; i < REMOTE_REPLY_PACKET_PART_CRC; i++) {
+            crc = send(crc, replyPacket.bytes[i]);
+        }
+        crc ^= REMOTE_CRC_XOR;
+        usart_putchar(&usart0, crc);
+        usart_putchar(&usart0, crc >> 8);
+    } else {
+        replyPacket.crc = 0;
+        for (uint8_t i = REMOTE_REPLY_PACKET_PART_HEADER; i < REMOTE_REPLY_PACKET_PART_CRC; i++) {
+            usart_putchar(&usart0, replyPacket.bytes[i]);
+            replyPacket.crc += replyPacket.bytes[i];
+        }
+        usart_putchar(&usart0, replyPacket.crc);
+    }
+}
+
+static void proceed(const bool valid) {
+    if (valid) {
+        linkIdle = 0;
         replyPacket.cmd = controlPacket.cmd;
         switch (controlPacket.cmd) {
             case REMOTE_PACKET_CMD_GET_RPS:
                 replyPacket.value8_0 = cdi_getRps();
                 break;
+            case REMOTE_PACKET_CMD_GET_PERIOD: {
+                uint32_t measured, predicted;
+                cdi_getPeriods(&measured, &predicted);
+                replyPacket.value16_0 = (measured > UINT16_MAX) ? UINT16_MAX : measured;
+                replyPacket.value16_1 = (predicted > UINT16_MAX) ? UINT16_MAX : predicted;
+                break;
+            }
+            case REMOTE_PACKET_CMD_GET_SYNC:
+                replyPacket.value32 = cdi_getSyncTime();
+                break;
+            case REMOTE_PACKET_CMD_GET_FAULTS: {
+                uint16_t rejected, resyncs;
+                cdi_getFaults(&rejected, &resyncs);
+                replyPacket.value16_0 = rejected;
+                replyPacket.value16_1 = resyncs;
+                break;
+            }
+            case REMOTE_PACKET_CMD_GET_LATENCY:
+                if (REMOTE_LATENCY_MIN == controlPacket.value8_1) {
+                    if (!takeLatency(controlPacket.value8_0, &latencyTaken.min,
+                                     &latencyTaken.average, &latencyTaken.max)) {
+                        latency_reset(&latencyTaken);
+                    }
+                }
+                replyPacket.value8_0 = controlPacket.value8_0;
+                replyPacket.value8_1 = controlPacket.value8_1;
+                if (REMOTE_LATENCY_MIN == controlPacket.value8_1) {
+                    replyPacket.value16_1 = latencyTaken.min;
+                } else if (REMOTE_LATENCY_AVERAGE == controlPacket.value8_1) {
+                    replyPacket.value16_1 = latencyTaken.average;
+                } else if (REMOTE_LATENCY_MAX == controlPacket.value8_1) {
+                    replyPacket.value16_1 = latencyTaken.max;
+                } else {
+                    replyPacket.value16_1 = 0;
+                }
+                break;
+            case REMOTE_PACKET_CMD_GET_STATS:
+                replyPacket.value8_0 = controlPacket.value8_0;
+                replyPacket.value8_1 = 0;
+                replyPacket.value16_1 = getStat(controlPacket.value8_0);
+                break;
+            case REMOTE_PACKET_CMD_GET_TRACE:
+                //NOTE: One buffer at most, the ISRs may trace faster than
+                //      the link drains
+                burstCmd = REMOTE_PACKET_CMD_GET_TRACE;
+                burstLeft = TRACE_BURST;
+                return;
+            case REMOTE_PACKET_CMD_GET_SAVE:
+                cdi_getSave(&replyPacket.value8_0, &replyPacket.value8_1);
+                break;
             case REMOTE_PACKET_CMD_GET_RECORD:
                 if (controlPacket.value8_0 < CDI_TIMING_RECORD_SLOTS) {
-                    replyPacket.value8_0 = controlPacket.value8_0;
-                    CdiTimingRecord *record = getTimingRecord(controlPacket.value8_0);
-                    replyPacket.value8_1 = record->rps;
-                    replyPacket.value8_2 = record->timing;
+                    getRecord(controlPacket.value8_0);
+                } else {
+                    return;
+                }
+                break;
+            case REMOTE_PACKET_CMD_GET_BREAKPOINT:
+                if (controlPacket.value8_0 < CDI_TIMING_RECORD_SLOTS) {
+                    getBreakpoint(controlPacket.value8_0);
                 } else {
                     return;
                 }
                 break;
+            case REMOTE_PACKET_CMD_GET_TABLE:
+                if (validRange(controlPacket.value8_0, controlPacket.value8_1)) {
+                    burstCmd = REMOTE_PACKET_CMD_GET_TABLE;
+                    burstNext = controlPacket.value8_0;
+                    burstLeft = controlPacket.value8_1;
+                    burstCrc = REMOTE_CRC_INIT;
+                }
+                return;
+            case REMOTE_PACKET_CMD_GET_GEOMETRY:
+                replyPacket.value8_0 = CDI_TIMING_RECORD_SLOTS;
+                replyPacket.value8_1 = CDI_MAPS;
+                replyPacket.value8_2 = CDI_TIMING_FRACTION_BITS;
+                replyPacket.value8_3 = CDI_VALUE_MAX;
+                break;
             case REMOTE_PACKET_CMD_GET_SHIFT:
                 replyPacket.value8_0 = cdi_getShift();
                 break;
+            case REMOTE_PACKET_CMD_GET_CURVE:
+                replyPacket.value8_0 = cdi_getCurve();
+                break;
+            case REMOTE_PACKET_CMD_GET_CRANK:
+                replyPacket.value8_0 = cdi_getCrankRps();
+                break;
+            case REMOTE_PACKET_CMD_GET_PREDICTOR:
+                replyPacket.value8_0 = cdi_getPredictor();
+                break;
+            case REMOTE_PACKET_CMD_GET_DWELL:
+                replyPacket.value8_0 = cdi_getDwell();
+                break;
+            case REMOTE_PACKET_CMD_GET_MAP:
+                replyPacket.value8_0 = cdi_getMap();
+                replyPacket.value8_1 = CDI_MAPS;
+                break;
             case REMOTE_PACKET_CMD_SET_RECORD:
-                if (controlPacket.value8_0 < CDI_TIMING_RECORD_SLOTS) {
-                    replyPacket.value8_0 = controlPacket.value8_0;
-                    cdi_setTimingRecord(controlPacket.value8_0, controlPacket.value8_1, controlPacket.value8_2);
-                    replyPacket.value8_1 = controlPacket.value8_1;
-                    replyPacket.value8_2 = controlPacket.value8_2;
+                if ((controlPacket.value8_0 < CDI_TIMING_RECORD_SLOTS) &&
+                        (controlPacket.value8_2 <= CDI_VALUE_MAX)) {
+                    cdi_setTimingRecord(controlPacket.value8_0, controlPacket.value8_1 * 60,
+                                        controlPacket.value8_2 * CDI_TIMING_STEPS);
+                    replyPacket.value32 = controlPacket.value32;
+                } else {
+                    return;
+                }
+                break;
+            case REMOTE_PACKET_CMD_SET_BREAKPOINT:
+                if (setBreakpoint()) {
+                    replyPacket.value32 = controlPacket.value32;
                 } else {
                     return;
                 }
                 break;
+            case REMOTE_PACKET_CMD_SET_TABLE:
+                if (tableLeft > 0) {
+                    dropTable();
+                }
+                if (!validRange(controlPacket.value8_0, controlPacket.value8_1)) {
+                    return;
+                }
+                tableNext = controlPacket.value8_0;
+                tableLeft = controlPacket.value8_1;
+                tableCrc = REMOTE_CRC_INIT;
+                tableRequest = controlPacket.value32;
+                tableIdle = 0;
+                return;
+            case REMOTE_PACKET_CMD_TABLE_RECORD:
+                //NOTE: The records stream in without a reply, the last one
+                //      completes the transfer and is answered by SET_TABLE
+                if ((0 == tableLeft) ||
+                        (tableNext != (controlPacket.value16_1 >> REMOTE_RECORD_SLOT_SHIFT)) ||
+                        !setBreakpoint()) {
+                    if (tableLeft > 0) {
+                        dropTable();
+                    }
+                    return;
+                }
+                tableCrc = crcRecord(tableCrc, &controlPacket.bytes[REMOTE_CONTROL_PACKET_PART_VALUE_0]);
+                tableNext++;
+                tableIdle = 0;
+                if (--tableLeft > 0) {
+                    return;
+                }
+                replyPacket.cmd = REMOTE_PACKET_CMD_SET_TABLE;
+                replyPacket.value32 = tableRequest;
+                if (((tableCrc ^ REMOTE_CRC_XOR) != replyPacket.value16_1) ||
+                        !cdi_commit()) {
+                    cdi_revert();
+                    return;
+                }
+                break;
             case REMOTE_PACKET_CMD_SET_SHIFT:
                 if (controlPacket.value8_0 < CDI_VALUE_MAX) {
                     cdi_setShift(controlPacket.value8_0);
@@ -64,18 +362,185 @@ static void proceed(void) {
                     return;
                 }
                 break;
+            case REMOTE_PACKET_CMD_SET_CURVE:
+                if (controlPacket.value8_0 <= CDI_CURVE_LINEAR) {
+                    cdi_setCurve(controlPacket.value8_0);
+                    replyPacket.value8_0 = controlPacket.value8_0;
+                } else {
+                    return;
+                }
+                break;
+            case REMOTE_PACKET_CMD_SET_CRANK:
+                cdi_setCrankRps(controlPacket.value8_0);
+                replyPacket.value8_0 = controlPacket.value8_0;
+                break;
+            case REMOTE_PACKET_CMD_SET_PREDICTOR:
+                if (controlPacket.value8_0 <= CDI_PREDICTOR_ACCEL) {
+                    cdi_setPredictor(controlPacket.value8_0);
+                    replyPacket.value8_0 = controlPacket.value8_0;
+                } else {
+                    return;
+                }
+                break;
+            case REMOTE_PACKET_CMD_SET_DWELL:
+                cdi_setDwell(controlPacket.value8_0);
+                replyPacket.value8_0 = controlPacket.value8_0;
+                break;
+            case REMOTE_PACKET_CMD_SET_MAP:
+                if (cdi_isEdited()) {
+                    replyPacket.value8_0 = cdi_getMap();
+                    replyPacket.value8_1 = REMOTE_MAP_EDITED;
+                } else if (cdi_setMap(controlPacket.value8_0)) {
+                    replyPacket.value8_0 = controlPacket.value8_0;
+                    replyPacket.value8_1 = 0;
+                } else {
+                    return;
+                }
+                break;
+            case REMOTE_PACKET_CMD_SET_BAUD: {
+                uint16_t divisor;
+                bool doubleSpeed;
+                if ((controlPacket.value32 <= REMOTE_BAUDRATE_MAX) &&
+                        usart_calcBaudrate(controlPacket.value32, &divisor, &doubleSpeed)) {
+                    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                        linkDivisor = divisor;
+                        linkDoubleSpeed = doubleSpeed;
+                        linkSwitch = REMOTE_LINK_SWITCH_CHECKS;
+                    }
+                    replyPacket.value32 = controlPacket.value32;
+                } else {
+                    return;
+                }
+                break;
+            }
+            case REMOTE_PACKET_CMD_COMMIT:
+                if (!cdi_commit()) {
+                    return;
+                }
+                break;
             case REMOTE_PACKET_CMD_SAVE_MEM:
-                cdi_saveMem();
+                if (!cdi_saveMem()) {
+                    return;
+                }
                 break;
             default:
                 return;
         }
-        replyPacket.crc = 0;
-        for (uint8_t i = REMOTE_REPLY_PACKET_PART_HEADER; i < REMOTE_REPLY_PACKET_PART_CRC; i++) {
-            usart_putchar(&usart0, replyPacket.bytes[i]);
-            replyPacket.crc += replyPacket.bytes[i];
+        reply();
+    } else if (crcErrors < UINT16_MAX) {
+        crcErrors++;
+    }
+}
+
+//NOTE: A bulk reply goes out one frame per pass, and only once the transmit
+//      buffer has room for the whole frame, so remote_work() never waits on
+//      the link and cdi_work() runs between the frames. No byte is taken
+//      until the last frame, so the request stays in controlPacket.
+static void burst(void) {
+    if (usart0.txBufferCount > USART_BUFFER_SIZE - REMOTE_FRAME_LEN_MAX) {
+        return;
+    }
+    replyPacket.cmd = burstCmd;
+    if (REMOTE_PACKET_CMD_GET_TRACE == burstCmd) {
+        TraceRecord record;
+        if ((burstLeft > 0) && trace_take(&record)) {
+            for (uint8_t i = 0; i < TRACE_RECORD_LEN; i++) {
+                replyPacket.bytes[REMOTE_REPLY_PACKET_PART_VALUE_0 + i] = record.bytes[i];
+            }
+            burstLeft--;
+            reply();
+            return;
         }
-        usart_putchar(&usart0, replyPacket.crc);
+        replyPacket.value32 = 0;
+    } else {
+        if (burstLeft > 0) {
+            replyPacket.cmd = REMOTE_PACKET_CMD_TABLE_RECORD;
+            getBreakpoint(burstNext++);
+            burstCrc = crcRecord(burstCrc, &replyPacket.bytes[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+            burstLeft--;
+            reply();
+            return;
+        }
+        replyPacket.value8_0 = controlPacket.value8_0;
+        replyPacket.value8_1 = controlPacket.value8_1;
+        replyPacket.value16_1 = burstCrc ^ REMOTE_CRC_XOR;
+    }
+    burstCmd = REMOTE_PACKET_CMD_UNDEFINED;
+    reply();
+}
+
+static void receivePacket(const uint8_t byte) {
+    controlPacket.bytes[receivedPartIndex] = byte;
+    if (REMOTE_CONTROL_PACKET_PART_CRC == receivedPartIndex) {
+        uint8_t crc = 0;
+        for (uint8_t i = 0; i < REMOTE_CONTROL_PACKET_PART_CRC; i++) {
+            crc += controlPacket.bytes[i];
+        }
+        proceed(crc == controlPacket.crc);
+        receivedPartIndex = REMOTE_CONTROL_PACKET_PART_HEADER;
+    } else {
+        receivedPartIndex++;
+    }
+}
+
+//NOTE: The received CRC is folded into the computed one, so a good frame
+//      ends with 0
+static void receiveFrame(const uint8_t byte) {
+    uint8_t end = REMOTE_FRAME_PART_PAYLOAD + frameLength;
+
+    if (receivedPartIndex < end) {
+        frameCrc = _crc_ccitt_update(frameCrc, byte);
+    }
+    switch (receivedPartIndex) {
+        case REMOTE_FRAME_PART_LEN:
+            if (byte > REMOTE_FRAME_PAYLOAD_MAX) {
+                if (crcErrors < UINT16_MAX) {
+                    crcErrors++;
+                }
+                receivedPartIndex = REMOTE_FRAME_PART_HEADER;
+                return;
+            }
+            frameLength = byte;
+            break;
+        case REMOTE_FRAME_PART_SEQ:
+            frameSeq = byte;
+            break;
+        case REMOTE_FRAME_PART_CMD:
+            controlPacket.cmd = byte;
+            controlPacket.value32 = 0;
+            break;
+        default:
+            if (receivedPartIndex < end) {
+                controlPacket.bytes[REMOTE_CONTROL_PACKET_PART_VALUE_0 +
+                        receivedPartIndex - REMOTE_FRAME_PART_PAYLOAD] = byte;
+            } else if (receivedPartIndex == end) {
+                frameCrc ^= REMOTE_CRC_XOR ^ byte;
+            } else {
+                proceed(0 == (frameCrc ^ ((uint16_t)byte << 8)));
+                receivedPartIndex = REMOTE_FRAME_PART_HEADER;
+                return;
+            }
+            break;
+    }
+    receivedPartIndex++;
+}
+
+//NOTE: The counts run on the transmitter going idle, so the rate never
+//      changes under the reply that granted it
+static void checkLink(VTimer *vtimer) {
+    if (linkSwitch > 0) {
+        if ((0 == usart0.txBufferCount) && (0 == --linkSwitch)) {
+            usart_loadBaudrate(&usart0, linkDivisor, linkDoubleSpeed);
+            linkFast = (UBRR_VALUE != linkDivisor) || (USE_2X != linkDoubleSpeed);
+            linkIdle = 0;
+        }
+    } else if (linkFast && (++linkIdle >= REMOTE_LINK_TIMEOUT_CHECKS)) {
+        usart_loadBaudrate(&usart0, UBRR_VALUE, USE_2X);
+        linkFast = false;
+    }
+    if ((tableLeft > 0) && (tableIdle < REMOTE_TABLE_TIMEOUT_CHECKS) &&
+            (++tableIdle == REMOTE_TABLE_TIMEOUT_CHECKS)) {
+        event_post(EVENT_LINK);
     }
 }
 
@@ -88,32 +553,36 @@ void remote_init(void) {
     remote_led(false);
     receivedPartIndex = REMOTE_CONTROL_PACKET_PART_HEADER;
     replyPacket.hdr = REMOTE_HEADER;
+    burstCmd = REMOTE_PACKET_CMD_UNDEFINED;
     usart_init(&usart0, USART_0, REMOTE_BAUDRATE);
+    vtimer_configSimple(&linkTimer, REMOTE_LINK_CHECK_HZ, checkLink);
+    vtimer_run(&linkTimer, 0);
 }
 
 void remote_work(void) {
-    if (usart0.rxBufferCount > 0) {
+    //NOTE: A transfer the host stopped feeding leaves no edits behind
+    if ((tableLeft > 0) && (tableIdle >= REMOTE_TABLE_TIMEOUT_CHECKS)) {
+        dropTable();
+    }
+    while ((REMOTE_PACKET_CMD_UNDEFINED == burstCmd) &&
+            (usart0.rxBufferCount > 0)) {
         uint8_t byte = usart_getchar(&usart0);
-        controlPacket.bytes[receivedPartIndex] = byte;
-        switch (receivedPartIndex) {
-            case REMOTE_CONTROL_PACKET_PART_HEADER:
-                if (REMOTE_HEADER == byte) {
-                    receivedPartIndex++;
-                }
-                break;
-            case REMOTE_CONTROL_PACKET_PART_CMD:
-            case REMOTE_CONTROL_PACKET_PART_VALUE_0:
-            case REMOTE_CONTROL_PACKET_PART_VALUE_1:
-            case REMOTE_CONTROL_PACKET_PART_VALUE_2:
-            case REMOTE_CONTROL_PACKET_PART_VALUE_3:
+        if (REMOTE_CONTROL_PACKET_PART_HEADER == receivedPartIndex) {
+            framed = (REMOTE_FRAME_HEADER == byte);
+            if (framed || (REMOTE_HEADER == byte)) {
+                frameCrc = _crc_ccitt_update(REMOTE_CRC_INIT, byte);
+                controlPacket.hdr = byte;
                 receivedPartIndex++;
-                break;
-            case REMOTE_CONTROL_PACKET_PART_CRC:
-                proceed();
-                receivedPartIndex = REMOTE_CONTROL_PACKET_PART_HEADER;
-                break;
+            }
+        } else if (framed) {
+            receiveFrame(byte);
+        } else {
+            receivePacket(byte);
         }
     }
+    if (REMOTE_PACKET_CMD_UNDEFINED != burstCmd) {
+        burst();
+    }
 }
 
 void remote_led(bool on) {
@@ -5,6 +5,33 @@
 #include <stdbool.h>
 
 #define REMOTE_BAUDRATE  19200
+//NOTE: The rates the host offers once connected, fastest first. A received
+//      byte may wait behind the longest chain of the other handlers, about
+//      4770 cycles, 2820 with STATIC=1, while two bytes take 4167 cycles at
+//      38400 and 2083 at 76800, so the device takes no rate above
+//      REMOTE_BAUDRATE_MAX. A byte lost to an overrun fails its frame, which
+//      the host sends again, and the host steps down a rate while the
+//      overrun counter still grows.
+#define REMOTE_BAUDRATE_MAX    38400
+#define REMOTE_BAUDRATES_FAST  REMOTE_BAUDRATE_MAX
+
+//NOTE: SET_BAUD carries a rate in value32 and replies with it at the old
+//      rate, a rate above REMOTE_BAUDRATE_MAX or out of the USART tolerance
+//      gets no reply. The device
+//      takes the new rate REMOTE_LINK_SWITCH_CHECKS checks after the reply
+//      has left, so the host waits REMOTE_LINK_SETTLE_MS before using it.
+//      The host gives a frame REMOTE_LINK_REPLY_MS and drops back to
+//      REMOTE_BAUDRATE after REMOTE_LINK_RETRIES of them went unanswered.
+//      The device drops back one reply time earlier, so the first frame
+//      the host sends at REMOTE_BAUDRATE finds it there, and a single lost
+//      frame still keeps the link.
+#define REMOTE_LINK_CHECK_HZ        20
+#define REMOTE_LINK_SWITCH_CHECKS   2
+#define REMOTE_LINK_SETTLE_MS       150
+#define REMOTE_LINK_REPLY_MS        500
+#define REMOTE_LINK_RETRIES         3
+#define REMOTE_LINK_TIMEOUT_MS      (REMOTE_LINK_SETTLE_MS + (REMOTE_LINK_RETRIES - 1) * REMOTE_LINK_REPLY_MS)
+#define REMOTE_LINK_TIMEOUT_CHECKS  (REMOTE_LINK_TIMEOUT_MS * REMOTE_LINK_CHECK_HZ / 1000)
 
 #define REMOTE_HEADER  0xAA
 
@@ -74,14 +101,139 @@ typedef union {
     };
 } RemoteReplyPacket;
 
+//NOTE: A v2 frame carries a length, a sequence number echoed by the replies
+//      and a CRC-16/X.25 of all the bytes before it, low byte first. The
+//      value bytes not sent read as 0 and replies always carry all four.
+//      The receive and transmit buffers hold REMOTE_FRAME_WINDOW frames
+//      of REMOTE_FRAME_LEN_MAX bytes, so the host may have that many
+//      frames on the way and matches the replies by their sequence.
+#define REMOTE_FRAME_HEADER  0xAB
+#define REMOTE_FRAME_WINDOW  3
+
+#define REMOTE_FRAME_PAYLOAD_MAX  4
+#define REMOTE_FRAME_OVERHEAD     6
+#define REMOTE_FRAME_LEN_MAX      (REMOTE_FRAME_OVERHEAD + REMOTE_FRAME_PAYLOAD_MAX)
+
+#define REMOTE_FRAME_PART_HEADER   0
+#define REMOTE_FRAME_PART_LEN      1
+#define REMOTE_FRAME_PART_SEQ      2
+#define REMOTE_FRAME_PART_CMD      3
+#define REMOTE_FRAME_PART_PAYLOAD  4
+
+#define REMOTE_CRC_INIT  0xFFFF
+#define REMOTE_CRC_XOR   0xFFFF
+
 #define REMOTE_PACKET_CMD_UNDEFINED   0x00
 #define REMOTE_PACKET_CMD_GET_RPS     0x01
+#define REMOTE_PACKET_CMD_GET_PERIOD  0x02
+#define REMOTE_PACKET_CMD_GET_SYNC    0x03
+#define REMOTE_PACKET_CMD_GET_FAULTS  0x04
+#define REMOTE_PACKET_CMD_GET_LATENCY 0x05
+#define REMOTE_PACKET_CMD_GET_STATS   0x06
+#define REMOTE_PACKET_CMD_GET_TRACE   0x07
+#define REMOTE_PACKET_CMD_GET_SAVE    0x08
+#define REMOTE_PACKET_CMD_GET_GEOMETRY  0x09
 #define REMOTE_PACKET_CMD_GET_RECORD  0x21
 #define REMOTE_PACKET_CMD_GET_SHIFT   0x22
+#define REMOTE_PACKET_CMD_GET_CURVE   0x23
+#define REMOTE_PACKET_CMD_GET_CRANK   0x24
+#define REMOTE_PACKET_CMD_GET_PREDICTOR  0x25
+#define REMOTE_PACKET_CMD_GET_DWELL   0x26
+#define REMOTE_PACKET_CMD_GET_MAP     0x27
+#define REMOTE_PACKET_CMD_GET_TABLE   0x28
+#define REMOTE_PACKET_CMD_GET_BREAKPOINT  0x2C
+#define REMOTE_PACKET_CMD_TABLE_RECORD  0x30
 #define REMOTE_PACKET_CMD_SET_RECORD  0xA1
 #define REMOTE_PACKET_CMD_SET_SHIFT   0xA2
+#define REMOTE_PACKET_CMD_SET_CURVE   0xA3
+#define REMOTE_PACKET_CMD_SET_CRANK   0xA4
+#define REMOTE_PACKET_CMD_SET_PREDICTOR  0xA5
+#define REMOTE_PACKET_CMD_SET_DWELL   0xA6
+#define REMOTE_PACKET_CMD_SET_MAP     0xA7
+#define REMOTE_PACKET_CMD_SET_TABLE   0xA8
+#define REMOTE_PACKET_CMD_SET_BAUD    0xA9
+#define REMOTE_PACKET_CMD_SET_BREAKPOINT  0xAC
+#define REMOTE_PACKET_CMD_COMMIT      0xAE
 #define REMOTE_PACKET_CMD_SAVE_MEM    0xAF
 
+//NOTE: SET_RECORD, SET_BREAKPOINT, SET_SHIFT and SET_CURVE fill the shadow
+//      table, the GET commands read it back, and COMMIT makes it the active
+//      one at once. SAVE_MEM starts storing the active table and the
+//      settings, COMMIT, SET_MAP and SAVE_MEM get no reply until it is over.
+//NOTE: GET_RECORD and SET_RECORD keep the v1 payload, the slot in value8_0,
+//      the rps in value8_1 and the timing in whole units in value8_2. The
+//      rpm and the timing are rounded to them on the way out, a timing above
+//      CDI_VALUE_MAX gets no reply.
+//NOTE: GET_BREAKPOINT and SET_BREAKPOINT carry the rpm in value16_0, the slot
+//      and the timing in 1 / CDI_TIMING_STEPS units packed into value16_1
+#define REMOTE_RECORD_SLOT_SHIFT    11
+#define REMOTE_RECORD_TIMING_MASK   ((1U << REMOTE_RECORD_SLOT_SHIFT) - 1)
+#define REMOTE_RECORD_SLOTS_MAX     (1U << (16 - REMOTE_RECORD_SLOT_SHIFT))
+
+//NOTE: GET_TABLE and SET_TABLE move the slots from value8_0 on, value8_1 of
+//      them, as one TABLE_RECORD frame per slot packed like GET_BREAKPOINT.
+//      GET_TABLE replies with the records, then with the range and the
+//      CRC-16/X.25 of their value bytes in value16_1. SET_TABLE carries the
+//      range and the CRC and the host streams the records right behind it
+//      in v2 frames. The main loop takes a frame well before the next one is
+//      in, so only the last record is answered, by SET_TABLE once the CRC
+//      matches and the table is committed. A broken transfer gets no reply
+//      and the host sends the whole table again, and a CRC
+//      mismatch, a record out of order or no record for
+//      REMOTE_TABLE_TIMEOUT_CHECKS checks reverts the shadow table to the
+//      active one, so SET_MAP is not locked out by a half written table.
+#define REMOTE_TABLE_TIMEOUT_CHECKS  (REMOTE_LINK_REPLY_MS * REMOTE_LINK_CHECK_HZ / 1000)
+
+//NOTE: GET_GEOMETRY replies with the number of records, the number of maps,
+//      the timing fraction bits and the value units per half revolution
+//NOTE: GET_SAVE replies with the steps left of the running save, 0 when
+//      it is over, and the bytes left of the current step
+//NOTE: GET_MAP replies with the selected map and the number of maps,
+//      SET_MAP loads a map from the EEPROM into both tables and replies with
+//      it. There are CDI_MAPS of them (4), the ATmega328P EEPROM holds no
+//      more maps of CDI_TIMING_RECORD_SLOTS records in two banks each.
+//      While the shadow table holds edits not committed yet the switch is
+//      refused, the reply carries the selected map and REMOTE_MAP_EDITED in
+//      value8_1.
+#define REMOTE_MAP_EDITED  1
+
+//NOTE: GET_LATENCY takes the slot in value8_0 and the field in value8_1
+//      and replies with both and the field in value16_1. The min field
+//      takes the statistics of the slot and starts them over, the average
+//      and max fields reply from that same take. The times are in CPU
+//      cycles, the edge slot in meter ticks, the average with
+//      REMOTE_LATENCY_AVERAGE_SHIFT fraction bits. A min above the max means
+//      no samples, or a firmware built without LATENCY_STATS. The plan slot
+//      times the main loop working out the delays for one edge.
+#define REMOTE_LATENCY_CAPTURE  0
+#define REMOTE_LATENCY_SPARK    1
+#define REMOTE_LATENCY_EDGE     2
+#define REMOTE_LATENCY_RX       3
+#define REMOTE_LATENCY_TX       4
+#define REMOTE_LATENCY_PLAN     5
+#define REMOTE_LATENCY_SLOTS    6
+
+#define REMOTE_LATENCY_MIN      0
+#define REMOTE_LATENCY_AVERAGE  1
+#define REMOTE_LATENCY_MAX      2
+#define REMOTE_LATENCY_FIELDS   3
+
+#define REMOTE_LATENCY_AVERAGE_SHIFT  3
+
+//NOTE: GET_STATS replies with the counter index and the counter in
+//      value16_1, every counter saturates at UINT16_MAX
+#define REMOTE_STATS_TEETH     0
+#define REMOTE_STATS_SPARKS    1
+#define REMOTE_STATS_SKIPPED   2
+#define REMOTE_STATS_RESYNCS   3
+#define REMOTE_STATS_STALLS    4
+#define REMOTE_STATS_OVERRUNS  5
+#define REMOTE_STATS_FRAMING   6
+#define REMOTE_STATS_CRC       7
+#define REMOTE_STATS_COUNTERS  8
+
+//NOTE: GET_TRACE drains the trace with one reply per record, the record in
+//      the value bytes, and ends with a record of TRACE_KIND_NONE
 void remote_init(void);
 void remote_work(void);
 void remote_led(bool on);
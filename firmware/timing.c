@@ -0,0 +1,144 @@
+#include "timing.h"
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+static uint16_t calcFraction(uint8_t shift, uint16_t timing) {
+    uint16_t value = shift * CDI_TIMING_STEPS - timing;
+
+    return ((uint32_t)value * (1UL << CDI_FRACTION_SHIFT) +
+            CDI_SPARKS * CDI_VALUE_MAX * CDI_TIMING_STEPS / 2) /
+            (CDI_SPARKS * CDI_VALUE_MAX * CDI_TIMING_STEPS);
+}
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+//NOTE: The linear curve runs straight in the period between two
+//      breakpoints. The last segment holds the speeds above the table.
+void timing_loadSegments(TimingSegment *segments, const CdiTable *table) {
+    const CdiTimingRecord *records = table->records;
+    bool linear = (CDI_CURVE_LINEAR == table->curve);
+
+    for (uint8_t i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
+        segments[i].span = UINT32_MAX;
+        if (records[i].rpm > 0) {
+            segments[i].span = CDI_FREQUENCY_HZ * 60UL / records[i].rpm;
+        }
+        segments[i].fraction = calcFraction(table->shift, records[i].timing);
+        segments[i].slope = 0;
+    }
+    for (uint8_t i = 0; i < CDI_TIMING_RECORD_SLOTS - 1; i++) {
+        uint32_t width = segments[i].span - segments[i + 1].span;
+        if (linear && (records[i].rpm > 0) &&
+                (segments[i].span > segments[i + 1].span)) {
+            int32_t rise = (int32_t)segments[i + 1].fraction - segments[i].fraction;
+            segments[i].slope = (rise * (1L << CDI_SLOPE_SHIFT)) / (int32_t)width;
+        }
+    }
+    if (!linear) {
+        segments[CDI_TIMING_RECORD_SLOTS - 1].fraction =
+                calcFraction(table->shift, CDI_TIMING_OVER_HIGH * CDI_TIMING_STEPS);
+    }
+}
+
+//NOTE: The period inside a segment is less than a breakpoint apart from its
+//      start, so the product stays within the rise of the segment
+uint16_t timing_getFraction(const TimingSegment *segments,
+                            uint32_t revolution) {
+    const TimingSegment *segment = segments;
+
+    while ((segment < &segments[CDI_TIMING_RECORD_SLOTS - 1]) &&
+            (revolution <= segment[1].span)) {
+        segment++;
+    }
+    if (revolution >= segment->span) {
+        return segment->fraction;
+    }
+    return segment->fraction + (int16_t)(((int32_t)(segment->span - revolution) *
+            segment->slope) >> CDI_SLOPE_SHIFT);
+}
+
+//NOTE: A spark is armed from the last edge before its angle, so only the
+//      remainder past that edge is extrapolated from the measured speed.
+//      Both sparks are referenced to the tooth edges the coils fired at on
+//      the scope captures of the stock module, the back one to the edge
+//      after the short gap and the front one to the next edge, the same
+//      edges the cranking sparks fire at.
+//      Its charge starts a dwell time ahead from the last edge before that
+//      moment, never earlier than half a revolution ahead of the spark.
+//      The edges are fractions of a revolution from the edge of origin, the
+//      sparks whose delay does not fit the meter are left out and counted
+//      in the result.
+uint8_t timing_planEdge(TimingPlan *plan, const uint16_t *edges,
+                        uint8_t origin, uint8_t edge, uint32_t revolution,
+                        uint16_t fraction, uint16_t dwellTicks) {
+    uint16_t mask = (1U << CDI_FRACTION_SHIFT) - 1;
+    uint16_t width = (edges[(edge + 1) % CDI_TICKS] - edges[edge]) & mask;
+    uint32_t gap = timing_scale(revolution, width);
+    uint32_t lead = revolution >> CDI_DWELL_DUTY_SHIFT;
+    uint8_t skipped = 0;
+
+    if (dwellTicks < lead) {
+        lead = dwellTicks;
+    }
+    for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+        uint8_t reference = (origin + ((CDI_SPARK_FRONT == i) ? 2 : 1)) % CDI_TICKS;
+        uint16_t ahead = ((edges[reference] - edges[edge]) & mask) + fraction;
+        int32_t start = (int32_t)timing_scale(revolution, ahead) - lead;
+
+        plan->charge[i] = TIMING_PLAN_NONE;
+        plan->spark[i] = TIMING_PLAN_NONE;
+        if (ahead > mask) {
+            continue;
+        }
+        if ((dwellTicks > 0) && (start < (int32_t)gap)) {
+            plan->charge[i] = (start > 0) ? start : 0;
+        }
+        if (ahead < width) {
+            uint32_t delay = timing_scale(revolution, ahead);
+            if (delay < TIMING_PLAN_NONE) {
+                plan->spark[i] = delay;
+            } else {
+                skipped++;
+            }
+        }
+    }
+    return skipped;
+}
+
+//NOTE: The sliding revolution sum is centred half a revolution back, so
+//      it is extrapolated by half a revolution with the backward
+//      differences taken one revolution apart:
+//      R + D / 2 + 3 * D2 / 8
+uint32_t timing_predict(TimingPredictor *predictor, uint8_t edge,
+                        uint32_t revolution) {
+    int32_t delta = revolution - predictor->sums[edge];
+    int32_t delta2 = delta - predictor->deltas[edge];
+    int32_t result;
+
+    predictor->sums[edge] = revolution;
+    predictor->deltas[edge] = delta;
+    if (predictor->history < CDI_PREDICTOR_HISTORY) {
+        predictor->history++;
+        return revolution;
+    }
+    result = revolution + (delta >> 1) + ((3 * delta2) >> 3);
+    if (result < (int32_t)(revolution >> 1)) {
+        return revolution >> 1;
+    }
+    if (result > (int32_t)(revolution << 1)) {
+        return revolution << 1;
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include "cdi.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+//NOTE: The arithmetic the sparks are planned and the edges checked with. It
+//      touches no hardware, so the host tools build the very same code.
+
+#define TIMING_PLAN_NONE  UINT16_MAX
+
+//NOTE: A segment covers the speeds from its breakpoint up to the next one.
+//      The speeds are kept as the revolution periods in meter ticks, so a
+//      segment is found without a division, and the slope is in fraction
+//      units per tick of the period with CDI_SLOPE_SHIFT fraction bits.
+typedef struct _TimingSegment {
+    uint32_t span;
+    uint16_t fraction;
+    int32_t slope;
+} TimingSegment;
+
+//NOTE: The delays from an edge the capture ISR arms at that edge
+typedef struct _TimingPlan {
+    uint16_t charge[CDI_SPARKS];
+    uint16_t spark[CDI_SPARKS];
+} TimingPlan;
+
+//NOTE: The revolution sums and their differences of the edges one
+//      revolution back, the predictor starts over from a zero history
+typedef struct _TimingPredictor {
+    uint32_t sums[CDI_TICKS];
+    int32_t deltas[CDI_TICKS];
+    uint8_t history;
+} TimingPredictor;
+
+static inline uint32_t timing_scale(uint32_t revolution, uint16_t fraction) {
+    return (revolution * fraction) >> CDI_FRACTION_SHIFT;
+}
+
+//NOTE: The window an edge is checked against spans the expected and the
+//      predicted gap, widened by 1 / 2^shift of them
+static inline uint32_t timing_windowLow(uint32_t expected, uint32_t predicted,
+                                        uint8_t shift) {
+    uint32_t low = (expected < predicted) ? expected : predicted;
+
+    return low - (low >> shift);
+}
+
+static inline uint32_t timing_windowHigh(uint32_t expected, uint32_t predicted,
+                                         uint8_t shift) {
+    uint32_t high = (expected < predicted) ? predicted : expected;
+
+    return high + (high >> shift);
+}
+
+void timing_loadSegments(TimingSegment *segments, const CdiTable *table);
+uint16_t timing_getFraction(const TimingSegment *segments,
+                            uint32_t revolution);
+uint8_t timing_planEdge(TimingPlan *plan, const uint16_t *edges,
+                        uint8_t origin, uint8_t edge, uint32_t revolution,
+                        uint16_t fraction, uint16_t dwellTicks);
+uint32_t timing_predict(TimingPredictor *predictor, uint8_t edge,
+                        uint32_t revolution);
+
+#endif /* TIMING_H_ */
@@ -0,0 +1,319 @@
+/****************************************************************************
+ * Host-side comparison of the spark delay accuracy of the rps-quantized    *
+ * ignition math against the period-domain fixed-point math.                *
+ *                                                                          *
+ * The old variant runs the default map cut to whole rps and value units   *
+ * through the rps lookup and the Timer0 loading it had, the new one runs  *
+ * the map itself through the segments and the edge plans of timing.c, as  *
+ * a step and as a linear curve. The error is reported in crankshaft       *
+ * degrees against the ideal spark angle at the exact engine speed, with   *
+ * the map looked up at the speed the meter reads in whole ticks.           *
+ *                                                                          *
+ * The edge check of the capture ISR is then run over speed steps, once    *
+ * with the fixed window around the gap one revolution back and once with  *
+ * the predicted gaps and the wider cranking window.                        *
+ ****************************************************************************/
+
+#include "cdi.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define ACCURACY_RPM_STEP     1
+#define ACCURACY_REPORT_STEP  300
+
+#define OLD_DELAY_FREQUENCY_HZ  (F_CPU / 256)
+#define OLD_SENSIBLE_RPS_MIN    16
+
+typedef struct {
+    uint8_t rps;
+    uint8_t timing;
+} AccuracyRecord;
+
+static const uint16_t prescale0[] = { 1, 8, 64, 256, 1024 };
+
+static const CdiTable tableDefault = CDI_TABLE_DEFAULT;
+
+//NOTE: The default map as the rps-keyed firmware held it, whole rps and
+//      whole value units
+static AccuracyRecord records[CDI_TIMING_RECORD_SLOTS];
+
+//NOTE: A wheel with one short gap, as the sync needs it, the angles of the
+//      edges are illustrative and taken as already learned
+static const double wheel[CDI_TICKS] = { 0, 100, 200, 270 };
+static uint16_t edges[CDI_TICKS];
+
+/****************************************************************************
+ * Ideal delay for the exact speed                                          *
+ ****************************************************************************/
+
+static double idealValue(const CdiTable *table, double rpm) {
+    const CdiTimingRecord *r = table->records;
+
+    for (int i = 0; i < CDI_TIMING_RECORD_SLOTS - 1; i++) {
+        if (rpm < r[i + 1].rpm) {
+            double timing = r[i].timing;
+            if ((CDI_CURVE_LINEAR == table->curve) && (rpm >= r[i].rpm)) {
+                timing += (double)((int)r[i + 1].timing - r[i].timing) *
+                          (rpm - r[i].rpm) / (r[i + 1].rpm - r[i].rpm);
+            }
+            return table->shift - timing / CDI_TIMING_STEPS;
+        }
+    }
+    if (CDI_CURVE_LINEAR == table->curve) {
+        return table->shift - (double)r[CDI_TIMING_RECORD_SLOTS - 1].timing / CDI_TIMING_STEPS;
+    }
+    return table->shift - CDI_TIMING_OVER_HIGH;
+}
+
+/****************************************************************************
+ * Rps-quantized math                                                       *
+ ****************************************************************************/
+
+static uint8_t oldValue(uint32_t rps) {
+    for (int i = 0; i < CDI_TIMING_RECORD_SLOTS - 1; i++) {
+        if (rps < records[i + 1].rps) {
+            return tableDefault.shift - records[i].timing;
+        }
+    }
+    return tableDefault.shift - CDI_TIMING_OVER_HIGH;
+}
+
+static double oldDelay(uint32_t revolution) {
+    uint8_t rps = CDI_FREQUENCY_HZ / revolution;
+    uint8_t value = oldValue(rps);
+
+    if ((0 == rps) || (0 == value)) {
+        return NAN;
+    }
+    if (rps < OLD_SENSIBLE_RPS_MIN) {
+        uint32_t waitCycles = OLD_DELAY_FREQUENCY_HZ * value /
+                ((uint32_t)rps * CDI_SPARKS * CDI_VALUE_MAX);
+        return (double)waitCycles / OLD_DELAY_FREQUENCY_HZ;
+    }
+    uint32_t freq = (uint32_t)rps * CDI_SPARKS * CDI_VALUE_MAX / value;
+    uint16_t ocr;
+    uint8_t dv = 0;
+    do {
+        ocr = F_CPU / (prescale0[dv++] * freq) - 1;
+    } while ((ocr > UINT8_MAX) && (dv < 5));
+    if (ocr > UINT8_MAX) {
+        return NAN;
+    }
+    if (0 == ocr) {
+        return (double)prescale0[dv - 1] * (UINT8_MAX + 1) / F_CPU;
+    }
+    return (double)prescale0[dv - 1] * (ocr + 1) / F_CPU;
+}
+
+/****************************************************************************
+ * Period-domain math of the firmware                                       *
+ ****************************************************************************/
+
+//NOTE: The error of a spark in degrees, from the edge whose plan arms it
+//      to the ideal angle past its reference edge, the worse of both sparks
+static double newError(const TimingSegment *segments, const CdiTable *table,
+                       double rpm) {
+    uint32_t revolution = (uint32_t)(CDI_FREQUENCY_HZ * 60.0 / rpm + 0.5);
+    uint16_t fraction = timing_getFraction(segments, revolution);
+    double ideal = idealValue(table, CDI_FREQUENCY_HZ * 60.0 / revolution) *
+                   360.0 / (CDI_SPARKS * CDI_VALUE_MAX);
+    double worst = 0;
+    bool armed[CDI_SPARKS] = { false };
+
+    for (uint8_t edge = 0; edge < CDI_TICKS; edge++) {
+        TimingPlan plan;
+
+        if (timing_planEdge(&plan, edges, 0, edge, revolution, fraction,
+                            CDI_DWELL_DEFAULT) > 0) {
+            return NAN;
+        }
+        for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+            double reference = wheel[(CDI_SPARK_FRONT == i) ? 2 : 1];
+            double angle, error;
+
+            if (TIMING_PLAN_NONE == plan.spark[i]) {
+                continue;
+            }
+            angle = wheel[edge] + plan.spark[i] * rpm * 6.0 / CDI_FREQUENCY_HZ;
+            error = fabs(angle - reference - ideal);
+            armed[i] = true;
+            if (error > worst) {
+                worst = error;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < CDI_SPARKS; i++) {
+        if (!armed[i]) {
+            return NAN;
+        }
+    }
+    return worst;
+}
+
+/****************************************************************************
+ * Edge check                                                               *
+ ****************************************************************************/
+
+#define GATE_STEP_S        0.000001
+#define GATE_CRANK_RPM     300
+#define GATE_CASES         3
+
+typedef struct {
+    const char *name;
+    double fromRpm, toRpm;
+    double rampS;
+} GateCase;
+
+//NOTE: The share of the revolution from an edge of the wheel to the next
+static double gateShare(uint8_t tooth) {
+    double next = (tooth + 1 < CDI_TICKS) ? wheel[tooth + 1] : 360;
+
+    return (next - wheel[tooth]) / 360;
+}
+
+static const GateCase gateCases[GATE_CASES] = {
+        { .name = "catch from cranking", .fromRpm = GATE_CRANK_RPM, .toRpm = 1500, .rampS = 0.2 },
+        { .name = "throttle blip",       .fromRpm = 1500,           .toRpm = 4500, .rampS = 0.08 },
+        { .name = "snap to the limit",   .fromRpm = 1200,           .toRpm = CDI_RPM_MAX, .rampS = 0.15 },
+};
+
+//NOTE: The edge check of the capture ISR, the expected gap taken as the
+//      predicted one until the predictions are gated
+static bool gateMiss(uint16_t result, uint16_t expected, uint16_t predicted, uint8_t shift) {
+    return (result < timing_windowLow(expected, predicted, shift)) ||
+           (result > timing_windowHigh(expected, predicted, shift));
+}
+
+//NOTE: The speed holds for two seconds, ramps linearly and holds again.
+//      Edges outside the window are counted and still taken, as if the
+//      check had let them through.
+static void gateRun(const GateCase *gate, int *oldMisses, int *newMisses) {
+    uint32_t crankExit = CDI_FREQUENCY_HZ / CDI_CRANK_RPS_DEFAULT;
+    uint32_t crankEnter = crankExit + (crankExit >> CDI_CRANK_HYSTERESIS_SHIFT);
+    uint16_t ticks[CDI_TICKS] = { 0 };
+    uint16_t gates[CDI_TICKS] = { 0 };
+    TimingPredictor predictor = { .history = 0 };
+    bool cranking = true, gated = false;
+    double angle = 0, next = gateShare(0), last = 0, t = 0;
+    double holdS = 2.0, endS = 2 * holdS + gate->rampS;
+    int edges = 0;
+    uint8_t tooth = 0;
+
+    *oldMisses = 0;
+    *newMisses = 0;
+    while (t < endS) {
+        double rpm = gate->fromRpm;
+        if (t > holdS + gate->rampS) {
+            rpm = gate->toRpm;
+        } else if (t > holdS) {
+            rpm += (gate->toRpm - gate->fromRpm) * (t - holdS) / gate->rampS;
+        }
+        angle += rpm / 60.0 * GATE_STEP_S;
+        t += GATE_STEP_S;
+        if (angle < next) {
+            continue;
+        }
+        uint32_t gap = (uint32_t)((t - last) * CDI_FREQUENCY_HZ + 0.5);
+        uint16_t result = (gap > UINT16_MAX) ? UINT16_MAX : gap;
+        last = t;
+        if (t > holdS / 2) {
+            if (gateMiss(result, ticks[tooth], ticks[tooth], CDI_WINDOW_SHIFT)) {
+                (*oldMisses)++;
+            }
+            if (gateMiss(result, ticks[tooth], gated ? gates[tooth] : ticks[tooth],
+                         cranking ? CDI_WINDOW_CRANK_SHIFT : CDI_WINDOW_SHIFT)) {
+                (*newMisses)++;
+            }
+        }
+        ticks[tooth] = result;
+        uint32_t revolution = 0;
+        for (uint8_t i = 0; i < CDI_TICKS; i++) {
+            revolution += ticks[i];
+        }
+        uint32_t estimate = timing_predict(&predictor, tooth, revolution);
+        for (uint8_t i = 0; i < CDI_TICKS; i++) {
+            double expect = estimate * gateShare(i);
+            gates[i] = (expect > UINT16_MAX) ? UINT16_MAX : (uint16_t)(expect + 0.5);
+        }
+        gated = (++edges > CDI_TICKS);
+        tooth = (tooth + 1) % CDI_TICKS;
+        next += gateShare(tooth);
+        if (cranking) {
+            cranking = !(revolution < crankExit);
+        } else {
+            cranking = (revolution > crankEnter);
+        }
+    }
+}
+
+/****************************************************************************
+ * Comparison                                                               *
+ ****************************************************************************/
+
+int main(void) {
+    CdiTable linear = tableDefault;
+    TimingSegment stepSegments[CDI_TIMING_RECORD_SLOTS];
+    TimingSegment linearSegments[CDI_TIMING_RECORD_SLOTS];
+    double oldMax = 0, stepMax = 0, linearMax = 0;
+    double oldSum = 0, stepSum = 0, linearSum = 0;
+    double oldBand = 0, stepBand = 0, linearBand = 0;
+    int count = 0;
+
+    for (int i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
+        const CdiTimingRecord *r = &tableDefault.records[i];
+        records[i].rps = r->rpm / 60;
+        records[i].timing = (r->timing + CDI_TIMING_STEPS / 2) / CDI_TIMING_STEPS;
+    }
+    for (int i = 0; i < CDI_TICKS; i++) {
+        edges[i] = (uint16_t)(wheel[i] * (1UL << CDI_FRACTION_SHIFT) / 360 + 0.5);
+    }
+    linear.curve = CDI_CURVE_LINEAR;
+    timing_loadSegments(stepSegments, &tableDefault);
+    timing_loadSegments(linearSegments, &linear);
+
+    printf("%6s %12s %12s %12s\n", "rpm", "old, deg", "step, deg", "linear, deg");
+    for (int rpm = CDI_RPM_MIN; rpm <= CDI_RPM_MAX; rpm += ACCURACY_RPM_STEP) {
+        double rps = rpm / 60.0;
+        uint32_t revolution = (uint32_t)(CDI_FREQUENCY_HZ / rps + 0.5);
+        double ideal = idealValue(&tableDefault, CDI_FREQUENCY_HZ * 60.0 / revolution) /
+                       (CDI_SPARKS * CDI_VALUE_MAX * rps);
+        double oldError = fabs((oldDelay(revolution) - ideal) * rps * 360.0);
+        double stepError = newError(stepSegments, &tableDefault, rpm);
+        double linearError = newError(linearSegments, &linear, rpm);
+
+        if (isnan(oldError) || isnan(stepError) || isnan(linearError)) {
+            continue;
+        }
+        oldSum += oldError;
+        stepSum += stepError;
+        linearSum += linearError;
+        count++;
+        oldMax = fmax(oldMax, oldError);
+        stepMax = fmax(stepMax, stepError);
+        linearMax = fmax(linearMax, linearError);
+        oldBand = fmax(oldBand, oldError);
+        stepBand = fmax(stepBand, stepError);
+        linearBand = fmax(linearBand, linearError);
+        if (0 == rpm % ACCURACY_REPORT_STEP) {
+            printf("%6d %12.3f %12.3f %12.3f\n", rpm, oldBand, stepBand, linearBand);
+            oldBand = 0;
+            stepBand = 0;
+            linearBand = 0;
+        }
+    }
+    printf("\nworst error, deg: old %.3f step %.3f linear %.3f\n",
+           oldMax, stepMax, linearMax);
+    printf("mean error, deg:  old %.3f step %.3f linear %.3f\n",
+           oldSum / count, stepSum / count, linearSum / count);
+
+    printf("\n%-20s %10s %10s %14s\n", "speed step", "from, rpm", "to, rpm", "rejects old/new");
+    for (int i = 0; i < GATE_CASES; i++) {
+        int oldMisses, newMisses;
+        gateRun(&gateCases[i], &oldMisses, &newMisses);
+        printf("%-20s %10.0f %10.0f %9d / %d\n", gateCases[i].name,
+               gateCases[i].fromRpm, gateCases[i].toRpm, oldMisses, newMisses);
+    }
+    return 0;
+}
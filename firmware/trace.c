@@ -0,0 +1,80 @@
+#include "trace.h"
+#include <avr/io.h>
+#include <util/atomic.h>
+
+/****************************************************************************
+ * Private types/enumerations/variables                                     *
+ ****************************************************************************/
+
+#ifdef TRACE_RECORDS
+//NOTE: The trace is sized for the 512 bytes of the ATmega48 whatever part
+//      it is built for, a quarter of them, so a trace build costs the same
+//      128 bytes on any of them
+#define TRACE_RAM_MAX  128
+
+#if (TRACE_RECORDS & (TRACE_RECORDS - 1)) || (TRACE_RECORDS > TRACE_RECORDS_MAX)
+#error "TRACE_RECORDS must be a power of two up to TRACE_RECORDS_MAX"
+#endif
+
+#define TRACE_MASK  (TRACE_RECORDS - 1)
+
+static TraceRecord records[TRACE_RECORDS];
+_Static_assert(sizeof(records) <= TRACE_RAM_MAX,
+               "The trace takes more than its share of the RAM");
+static volatile uint8_t head;
+static uint8_t tail;
+#endif
+
+/****************************************************************************
+ * Public types/enumerations/variables                                      *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private functions                                                        *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Public functions                                                         *
+ ****************************************************************************/
+
+#ifdef TRACE_RECORDS
+//NOTE: Only called from the main loop, like trace_take(), so the trace
+//      needs no locking
+void trace_put(const TraceKind kind, const uint8_t index, const uint16_t value) {
+    uint8_t slot = head;
+    TraceRecord *record = &records[slot & TRACE_MASK];
+
+    record->tag = TRACE_TAG(kind, index);
+    record->sequence = slot;
+    record->value = value;
+    head = slot + 1;
+}
+#endif
+
+//NOTE: The reader never blocks the writer. Records the writer has lapped
+//      are reported as one LOST record, and a copy the writer overwrote
+//      meanwhile is detected by the head it finds afterwards.
+bool trace_take(TraceRecord *record) {
+#ifdef TRACE_RECORDS
+    uint8_t behind = head - tail;
+
+    if (0 == behind) {
+        return false;
+    }
+    if (behind <= TRACE_RECORDS) {
+        *record = records[tail & TRACE_MASK];
+        if ((uint8_t)(head - tail) <= TRACE_RECORDS) {
+            tail++;
+            return true;
+        }
+        behind = head - tail;
+    }
+    record->tag = TRACE_TAG(TRACE_KIND_LOST, 0);
+    record->sequence = tail;
+    record->value = behind - TRACE_RECORDS;
+    tail += behind - TRACE_RECORDS;
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,49 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//NOTE: TRACE_RECORDS is set by the build, a power of two up to
+//      TRACE_RECORDS_MAX, without it the trace is left out entirely
+#define TRACE_RECORD_LEN   4
+#define TRACE_RECORDS_MAX  32
+
+typedef enum TRACE_KIND {
+    TRACE_KIND_NONE = 0,
+    TRACE_KIND_EDGE = 1,
+    TRACE_KIND_REJECT = 2,
+    TRACE_KIND_CHARGE = 3,
+    TRACE_KIND_DELAY = 4,
+    TRACE_KIND_SPARK = 5,
+    TRACE_KIND_STALL = 6,
+    TRACE_KIND_LOST = 7
+} TraceKind;
+
+//NOTE: The tag keeps the kind in the high nibble and the tooth or spark
+//      index in the low one. EDGE, REJECT, SPARK and STALL carry the meter
+//      time stamp, CHARGE and DELAY the ticks from the last edge, LOST the
+//      number of records overwritten before they were read.
+typedef union {
+    uint8_t bytes[TRACE_RECORD_LEN];
+    struct {
+        uint8_t tag;
+        uint8_t sequence;
+        uint16_t value;
+    };
+} TraceRecord;
+
+#define TRACE_TAG(kind, index)  ((uint8_t)(((kind) << 4) | ((index) & 0xF)))
+#define TRACE_KIND(tag)         ((TraceKind)((tag) >> 4))
+#define TRACE_INDEX(tag)        ((tag) & 0xF)
+
+#ifdef TRACE_RECORDS
+#define TRACE_BURST  TRACE_RECORDS
+void trace_put(const TraceKind kind, const uint8_t index, const uint16_t value);
+#else
+#define TRACE_BURST  0
+#define trace_put(kind, index, value)
+#endif
+bool trace_take(TraceRecord *record);
+
+#endif /* TRACE_H_ */
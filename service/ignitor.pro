@@ -8,6 +8,8 @@ TARGET = ignitor
 TEMPLATE = app
 
 DEFINES += QT_DEPRECATED_WARNINGS
+# The CLK of firmware/Makefile, the device times are converted with it
+DEFINES += F_CPU=8000000UL
 
 win32 {
     INCLUDEPATH += "C:/Program Files (x86)/L-Card"
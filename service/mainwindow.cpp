@@ -2,17 +2,24 @@
 #include "ui_ignitor.h"
 #include "remote.h"
 #include "cdi.h"
+#include "trace.h"
 #include <QAction>
 #include <QCloseEvent>
 #include <QSerialPortInfo>
 #include <QtEndian>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QTextStream>
 
 #include <QDebug>
 
 constexpr char MainWindow::timingsFileExtension[];
 
+//NOTE: The link steps down to REMOTE_BAUDRATE last when even the slowest
+//      fast rate keeps losing bytes
+static const quint32 linkRates[] = { REMOTE_BAUDRATES_FAST, REMOTE_BAUDRATE };
+static const int linkRatesCount = sizeof(linkRates) / sizeof(linkRates[0]);
+
 MainWindow::MainWindow(QWidget *parent)
   : QMainWindow(parent)
   , ui(new Ui::MainWindow)
@@ -20,8 +27,17 @@ MainWindow::MainWindow(QWidget *parent)
   , signalMapperGeneratorLtr35(new QSignalMapper(this))
   , signalMapperValue(new QSignalMapper(this))
   , serial(new QSerialPort)
-  , cmd(REMOTE_PACKET_CMD_GET_SHIFT)
-  , recordIdx(0)
+  , cmd(REMOTE_PACKET_CMD_SET_BAUD)
+  , frameSeq(0)
+  , portTimeouts(0)
+  , linkRateIdx(0)
+  , linkOverruns(-1)
+  , timingSteps(CDI_TIMING_STEPS)
+  , mapIdx(0)
+  , latencyIdx(0)
+  , latencyField(REMOTE_LATENCY_MIN)
+  , latencyValues()
+  , statsIdx(0)
   , ltr35(new Ltr35)
 {
     TLTR ltrCrate;
@@ -99,10 +115,21 @@ MainWindow::MainWindow(QWidget *parent)
     ui->spinBoxSpeedSet->setSingleStep(CDI_RPM_STEP);
     ui->spinBoxShiftSet->setMinimum(CDI_TIMING_UNDER_LOW);
     ui->spinBoxShiftSet->setMaximum(CDI_VALUE_MAX);
+    ui->spinBoxCrankSet->setMinimum(0);
+    ui->spinBoxCrankSet->setMaximum(CDI_RPM_MAX);
+    ui->spinBoxCrankSet->setSingleStep(CDI_RPM_STEP);
+    ui->doubleSpinBoxDwellSet->setMinimum(0);
+    ui->doubleSpinBoxDwellSet->setMaximum(UINT8_MAX * 1000.0 / CDI_DWELL_UNIT_HZ);
+    ui->doubleSpinBoxDwellSet->setSingleStep(1000.0 / CDI_DWELL_UNIT_HZ);
 
-    for (int i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
-        timingsUi.append(createTimingUi(ui->gridLayoutTimings, QString("%1").arg(i + 1), i + 1));
-    }
+    setupTimings(CDI_TIMING_RECORD_SLOTS);
+    latenciesUi << ui->lineEditLatencyCapture << ui->lineEditLatencySpark
+                << ui->lineEditLatencyEdge << ui->lineEditLatencyRx
+                << ui->lineEditLatencyTx << ui->lineEditLatencyPlan;
+    statsUi << ui->lineEditStatsTeeth << ui->lineEditStatsSparks
+            << ui->lineEditStatsSkipped << ui->lineEditStatsResyncs
+            << ui->lineEditStatsStalls << ui->lineEditStatsOverruns
+            << ui->lineEditStatsFraming << ui->lineEditStatsCrc;
     lockTimings(true);
     connect(ui->spinBoxShiftSet, SIGNAL(valueChanged(int)), this, SLOT(calcAllValues()));
     connect(signalMapperValue, SIGNAL(mapped(int)), this, SLOT(calcValue(int)));
@@ -157,10 +184,12 @@ MainWindow::TimingUi MainWindow::createTimingUi(QGridLayout *layout, QString nam
     uiTimings.rpm->setSingleStep(CDI_RPM_STEP);
     layout->addWidget(uiTimings.rpm, row, column++);
 
-    uiTimings.timing = new QSpinBox();
+    uiTimings.timing = new QDoubleSpinBox();
+    uiTimings.timing->setDecimals(2);
     uiTimings.timing->setMinimum(CDI_TIMING_UNDER_LOW);
     uiTimings.timing->setMaximum(CDI_TIMING_OVER_HIGH);
-    connect(uiTimings.timing, SIGNAL(valueChanged(int)), signalMapperValue, SLOT(map()));
+    uiTimings.timing->setSingleStep(1.0 / timingSteps);
+    connect(uiTimings.timing, SIGNAL(valueChanged(double)), signalMapperValue, SLOT(map()));
     signalMapperValue->setMapping(uiTimings.timing, row);
     layout->addWidget(uiTimings.timing, row, column++);
 
@@ -171,6 +200,19 @@ MainWindow::TimingUi MainWindow::createTimingUi(QGridLayout *layout, QString nam
     return uiTimings;
 }
 
+void MainWindow::setupTimings(int slots) {
+    while (!timingsUi.isEmpty()) {
+        TimingUi uiTimings = timingsUi.takeLast();
+        delete uiTimings.index;
+        delete uiTimings.rpm;
+        delete uiTimings.timing;
+        delete uiTimings.value;
+    }
+    for (int i = 0; i < slots; i++) {
+        timingsUi.append(createTimingUi(ui->gridLayoutTimings, QString("%1").arg(i + 1), i + 1));
+    }
+}
+
 void MainWindow::lockShift(bool lock) {
     ui->pushButtonShiftSet->setEnabled(!lock);
     ui->checkBoxShiftAutoset->setEnabled(!lock);
@@ -178,7 +220,10 @@ void MainWindow::lockShift(bool lock) {
 
 void MainWindow::lockTimings(bool lock) {
     ui->pushButtonUpdate->setEnabled(!lock);
+    ui->comboBoxMap->setEnabled(!lock);
+    ui->checkBoxInterpolate->setEnabled(!lock);
     ui->actionWriteMemory->setEnabled(!lock);
+    ui->actionDumpTrace->setEnabled(!lock);
 }
 
 bool MainWindow::loadTimingsFile(QString fileName) {
@@ -189,22 +234,30 @@ bool MainWindow::loadTimingsFile(QString fileName) {
         result = !byteArray.isEmpty();
         QDataStream stream(byteArray);
         stream.setVersion(QDataStream::Qt_5_4);
+        int version;
         int shift;
-        TimingRecord timings[CDI_TIMING_RECORD_SLOTS];
-        stream >> shift
-               >> timings[0].rpm >> timings[0].timing
-               >> timings[1].rpm >> timings[1].timing
-               >> timings[2].rpm >> timings[2].timing
-               >> timings[3].rpm >> timings[3].timing
-               >> timings[4].rpm >> timings[4].timing
-               >> timings[5].rpm >> timings[5].timing
-               >> timings[6].rpm >> timings[6].timing
-               >> timings[7].rpm >> timings[7].timing
-               >> timings[8].rpm >> timings[8].timing
-               >> timings[9].rpm >> timings[9].timing
-               >> timings[10].rpm >> timings[10].timing;
+        int count = 11;
+        stream >> version;
+        if (timingsFileVersion == version) {
+            stream >> shift >> count;
+        } else {
+            shift = version;
+        }
+        QList<TimingRecord> timings;
+        for (int i = 0; (i < count) && (QDataStream::Ok == stream.status()); i++) {
+            TimingRecord record;
+            if (timingsFileVersion == version) {
+                stream >> record.rpm >> record.timing;
+            } else {
+                int timing;
+                stream >> record.rpm >> timing;
+                record.timing = timing;
+            }
+            timings.append(record);
+        }
+        result &= (QDataStream::Ok == stream.status());
         ui->spinBoxShiftSet->setValue(shift);
-        for (int i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
+        for (int i = 0; (i < timings.size()) && (i < timingsUi.size()); i++) {
             timingsUi[i].rpm->setValue(timings[i].rpm);
             timingsUi[i].timing->setValue(timings[i].timing);
         }
@@ -222,23 +275,10 @@ bool MainWindow::saveTimingsFile(QString fileName) {
         QDataStream stream(&byteArray, QIODevice::WriteOnly);
         stream.setVersion(QDataStream::Qt_5_4);
         int shift = ui->spinBoxShiftSet->value();
-        TimingRecord timings[CDI_TIMING_RECORD_SLOTS];
-        for (int i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
-            timings[i].rpm = timingsUi[i].rpm->value();
-            timings[i].timing = timingsUi[i].timing->value();
+        stream << timingsFileVersion << shift << timingsUi.size();
+        for (int i = 0; i < timingsUi.size(); i++) {
+            stream << timingsUi[i].rpm->value() << timingsUi[i].timing->value();
         }
-        stream << shift
-               << timings[0].rpm << timings[0].timing
-               << timings[1].rpm << timings[1].timing
-               << timings[2].rpm << timings[2].timing
-               << timings[3].rpm << timings[3].timing
-               << timings[4].rpm << timings[4].timing
-               << timings[5].rpm << timings[5].timing
-               << timings[6].rpm << timings[6].timing
-               << timings[7].rpm << timings[7].timing
-               << timings[8].rpm << timings[8].timing
-               << timings[9].rpm << timings[9].timing
-               << timings[10].rpm << timings[10].timing;
         result = file.write(byteArray);
         file.close();
     } else {
@@ -257,8 +297,11 @@ void MainWindow::setPort(const QString &portname) {
     semaphoreTransmitComplete.acquire(semaphoreTransmitComplete.available());
     semaphoreTransmitComplete.release();
     mutexRequest.lock();
-    recordIdx = 0;
-    cmd = REMOTE_PACKET_CMD_GET_SHIFT;
+    framesInFlight.clear();
+    tableData.clear();
+    cmd = REMOTE_PACKET_CMD_SET_BAUD;
+    portTimeouts = 0;
+    linkRateIdx = 0;
     mutexRequest.unlock();
     serial.setPortName(portname);
     if (serial.open(QIODevice::ReadWrite)) {
@@ -292,7 +335,7 @@ void MainWindow::setGeneratorLtr35(const QString &generator) {
 }
 
 void MainWindow::calcValue(int row) {
-    int timing = timingsUi[row - 1].timing->value();
+    double timing = timingsUi[row - 1].timing->value();
     int shift = ui->spinBoxShiftSet->value();
     if ((shift - timing >= 0) && (shift - timing <= CDI_VALUE_MAX)) {
         timingsUi[row - 1].value->setText(QString("%1").arg(shift - timing));
@@ -302,131 +345,496 @@ void MainWindow::calcValue(int row) {
 }
 
 void MainWindow::calcAllValues() {
-    for (int i = 1 ; i <= CDI_TIMING_RECORD_SLOTS; i++) {
+    for (int i = 1 ; i <= timingsUi.size(); i++) {
         calcValue(i);
     }
 }
 
 void MainWindow::portRead() {
-    uint8_t data[REMOTE_REPLY_PACKET_LEN];
+    uint8_t frame[REMOTE_FRAME_LEN_MAX];
+    uint8_t data[REMOTE_REPLY_PACKET_LEN] = {};
 
     if (serial.isOpen()) {
-        if (serial.bytesAvailable() >= REMOTE_REPLY_PACKET_LEN) {
-            timerPortReply.stop();
-            serial.read(reinterpret_cast<char *>(&data[REMOTE_REPLY_PACKET_PART_HEADER]), 1);
-            if (REMOTE_HEADER == data[REMOTE_REPLY_PACKET_PART_HEADER]) {
-                serial.read(reinterpret_cast<char *>(&data[REMOTE_REPLY_PACKET_PART_CMD]), REMOTE_REPLY_PACKET_LEN - 1);
-                uint8_t crc = 0;
-                for (int i = REMOTE_REPLY_PACKET_PART_HEADER; i < REMOTE_REPLY_PACKET_PART_CRC; i++) {
-                    crc += data[i];
+        if (serial.bytesAvailable() >= REMOTE_FRAME_OVERHEAD) {
+            QByteArray head = serial.peek(REMOTE_FRAME_PART_PAYLOAD);
+            uint8_t length = head[REMOTE_FRAME_PART_LEN];
+            if ((REMOTE_FRAME_HEADER == uint8_t(head[REMOTE_FRAME_PART_HEADER])) &&
+                    (length <= REMOTE_FRAME_PAYLOAD_MAX)) {
+                if (serial.bytesAvailable() < REMOTE_FRAME_OVERHEAD + length) {
+                    return;
                 }
-                if (crc == data[REMOTE_REPLY_PACKET_PART_CRC]) {
-                    if (REMOTE_PACKET_CMD_GET_RPS == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                timerPortReply.stop();
+                serial.read(reinterpret_cast<char *>(frame), REMOTE_FRAME_OVERHEAD + length);
+                quint16 crc = qFromLittleEndian<quint16>(&frame[REMOTE_FRAME_PART_PAYLOAD + length]);
+                data[REMOTE_REPLY_PACKET_PART_CMD] = frame[REMOTE_FRAME_PART_CMD];
+                memcpy(&data[REMOTE_REPLY_PACKET_PART_VALUE_0], &frame[REMOTE_FRAME_PART_PAYLOAD], length);
+                //NOTE: A reply to an earlier request that timed out is dropped.
+                //      The replies come in the order of the requests, so the
+                //      frames sent before the one replied to are lost.
+                if ((qChecksum(reinterpret_cast<char *>(frame), REMOTE_FRAME_PART_PAYLOAD + length) == crc) &&
+                        framesInFlight.contains(frame[REMOTE_FRAME_PART_SEQ])) {
+                    while (framesInFlight.first() != frame[REMOTE_FRAME_PART_SEQ]) {
+                        framesInFlight.removeFirst();
+                    }
+                    if (REMOTE_PACKET_CMD_SET_BAUD == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        quint32 baudrate = qFromLittleEndian<quint32>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        serial.setBaudRate(baudrate);
+                        ui->statusbar->showMessage(QString("Link at %1 baud").arg(baudrate));
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_GEOMETRY;
+                        mutexRequest.unlock();
+                        portTimeouts = 0;
+                        linkOverruns = -1;
+                        framesInFlight.clear();
+                        QTimer::singleShot(REMOTE_LINK_SETTLE_MS, this, SLOT(portSettled()));
+                        return;
+                    } else if (REMOTE_PACKET_CMD_GET_RPS == data[REMOTE_REPLY_PACKET_PART_CMD]) {
                         uint8_t rps = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
                         QString rpm = QString("%1").arg(rps * 60);
                         if (ui->lineEditSpeedReal->text() != rpm) {
                             ui->lineEditSpeedReal->setText(rpm);
                         }
-                    } else if (REMOTE_PACKET_CMD_GET_RECORD == data[REMOTE_REPLY_PACKET_PART_CMD]) {
-                        uint8_t idx = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
-                        uint8_t rps = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
-                        uint8_t timing = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
-                        timingsUi[idx].rpm->setValue(rps * 60);
-                        timingsUi[idx].timing->setValue(timing);
-                        timingsUi[idx].value->setText(QString("%1").arg(ui->spinBoxShiftSet->value() - timing));
-                        mutexRequest.lock();
-                        recordIdx++;
-                        if (CDI_TIMING_RECORD_SLOTS == recordIdx) {
-                            ui->statusbar->showMessage("Timings loaded from device");
-                            lockTimings(false);
-                            if (ui->checkBoxShiftAutoset->isChecked()) {
-                                cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            cmd = REMOTE_PACKET_CMD_GET_PERIOD;
+                            mutexRequest.unlock();
+                        }
+                    } else if (REMOTE_PACKET_CMD_GET_PERIOD == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint16_t measured = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint16_t predicted = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        ui->lineEditPeriodMeasured->setText(QString("%1").arg(measured * 1000000.0 / CDI_FREQUENCY_HZ, 0, 'f', 0));
+                        ui->lineEditPeriodPredicted->setText(QString("%1").arg(predicted * 1000000.0 / CDI_FREQUENCY_HZ, 0, 'f', 0));
+                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            cmd = REMOTE_PACKET_CMD_GET_SYNC;
+                            mutexRequest.unlock();
+                        }
+                    } else if (REMOTE_PACKET_CMD_GET_SYNC == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint32_t firstSpark = qFromLittleEndian<quint32>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        ui->lineEditFirstSpark->setText(QString("%1").arg(firstSpark * 1000.0 / CDI_FREQUENCY_HZ, 0, 'f', 1));
+                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            cmd = REMOTE_PACKET_CMD_GET_FAULTS;
+                            mutexRequest.unlock();
+                        }
+                    } else if (REMOTE_PACKET_CMD_GET_FAULTS == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint16_t rejected = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint16_t resyncs = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        ui->lineEditFaults->setText(QString("%1 / %2").arg(rejected).arg(resyncs));
+                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            cmd = REMOTE_PACKET_CMD_GET_LATENCY;
+                            mutexRequest.unlock();
+                        }
+                    } else if (REMOTE_PACKET_CMD_GET_LATENCY == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t slot = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t field = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
+                        uint16_t value = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        if (field < REMOTE_LATENCY_FIELDS) {
+                            latencyValues[field] = value;
+                        }
+                        if ((slot < REMOTE_LATENCY_SLOTS) && (REMOTE_LATENCY_MAX == field)) {
+                            double unit = 1000000.0 / F_CPU;
+                            if (REMOTE_LATENCY_EDGE == slot) {
+                                unit = 1000000.0 / CDI_FREQUENCY_HZ;
+                            }
+                            if (latencyValues[REMOTE_LATENCY_MIN] > latencyValues[REMOTE_LATENCY_MAX]) {
+                                latenciesUi[slot]->setText(QString("-"));
                             } else {
-                                cmd = REMOTE_PACKET_CMD_GET_RPS;
+                                latenciesUi[slot]->setText(QString("%1 / %2 / %3")
+                                                           .arg(latencyValues[REMOTE_LATENCY_MIN] * unit, 0, 'f', 1)
+                                                           .arg(latencyValues[REMOTE_LATENCY_AVERAGE] * unit / (1 << REMOTE_LATENCY_AVERAGE_SHIFT), 0, 'f', 1)
+                                                           .arg(latencyValues[REMOTE_LATENCY_MAX] * unit, 0, 'f', 1));
+                            }
+                        }
+                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            latencyField = (field + 1) % REMOTE_LATENCY_FIELDS;
+                            if (REMOTE_LATENCY_MIN == latencyField) {
+                                latencyIdx = (slot + 1) % REMOTE_LATENCY_SLOTS;
                             }
+                            cmd = REMOTE_PACKET_CMD_GET_STATS;
+                            mutexRequest.unlock();
                         }
+                    } else if (REMOTE_PACKET_CMD_GET_STATS == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t idx = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint16_t counter = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        if (idx < REMOTE_STATS_COUNTERS) {
+                            statsUi[idx]->setText(QString("%1").arg(counter));
+                        }
+                        //NOTE: Overruns that keep growing at a fast rate mean the
+                        //      device's handlers hold the receiver up too long
+                        //      for it, so the link steps down to the next rate
+                        bool slower = false;
+                        if ((REMOTE_STATS_OVERRUNS == idx) && (REMOTE_BAUDRATE != serial.baudRate())) {
+                            slower = (linkOverruns >= 0) && (counter > linkOverruns) &&
+                                    (linkRateIdx + 1 < linkRatesCount);
+                            linkOverruns = counter;
+                        }
+                        if (slower) {
+                            mutexRequest.lock();
+                            linkRateIdx++;
+                            cmd = REMOTE_PACKET_CMD_SET_BAUD;
+                            mutexRequest.unlock();
+                        } else if (!ui->checkBoxShiftAutoset->isChecked()) {
+                            mutexRequest.lock();
+                            statsIdx = (idx + 1) % REMOTE_STATS_COUNTERS;
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                            mutexRequest.unlock();
+                        }
+                    } else if (REMOTE_PACKET_CMD_TABLE_RECORD == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        tableData.append(reinterpret_cast<char *>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]), sizeof(quint32));
+                        timerPortReply.start(REMOTE_LINK_REPLY_MS);
+                        return;
+                    } else if (REMOTE_PACKET_CMD_GET_TABLE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t first = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t count = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
+                        uint16_t crc = qFromLittleEndian<quint16>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        if ((0 == first) && (timingsUi.size() == count) &&
+                                (tableData.size() == count * int(sizeof(quint32))) &&
+                                (qChecksum(tableData.constData(), tableData.size()) == crc)) {
+                            for (int i = 0; i < count; i++) {
+                                const uchar *record = reinterpret_cast<const uchar *>(tableData.constData()) + i * sizeof(quint32);
+                                uint16_t rpm = qFromLittleEndian<quint16>(record);
+                                uint16_t word = qFromLittleEndian<quint16>(record + sizeof(quint16));
+                                timingsUi[i].rpm->setValue(rpm);
+                                timingsUi[i].timing->setValue(double(word & REMOTE_RECORD_TIMING_MASK) / timingSteps);
+                                calcValue(i + 1);
+                            }
+                            mutexRequest.lock();
+                            cmd = REMOTE_PACKET_CMD_GET_CURVE;
+                            mutexRequest.unlock();
+                        } else {
+                            ui->statusbar->showMessage("Timings transfer failed, retrying");
+                        }
+                    } else if (REMOTE_PACKET_CMD_GET_CURVE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t curve = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        ui->checkBoxInterpolate->setChecked(CDI_CURVE_LINEAR == curve);
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_CRANK;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_CRANK == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t crankRps = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        ui->spinBoxCrankSet->setValue(crankRps * 60);
+                        ui->pushButtonCrankSet->setEnabled(true);
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_PREDICTOR;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_PREDICTOR == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t predictor = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        ui->checkBoxPredict->setChecked(CDI_PREDICTOR_ACCEL == predictor);
+                        ui->checkBoxPredict->setEnabled(true);
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_DWELL;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_DWELL == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t dwell = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        ui->doubleSpinBoxDwellSet->setValue(dwell * 1000.0 / CDI_DWELL_UNIT_HZ);
+                        ui->pushButtonDwellSet->setEnabled(true);
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_MAP;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_MAP == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t map = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t maps = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
+                        ui->comboBoxMap->clear();
+                        for (int i = 0; i < maps; i++) {
+                            ui->comboBoxMap->addItem(QString("Map %1").arg(i + 1));
+                        }
+                        ui->comboBoxMap->setCurrentIndex(map);
+                        ui->statusbar->showMessage("Timings loaded from device");
+                        lockTimings(false);
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                        }
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_GEOMETRY == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t slots = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t bits = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+                        if ((slots != timingsUi.size()) || ((1 << bits) != timingSteps)) {
+                            timingSteps = 1 << bits;
+                            setupTimings(slots);
+                            lockTimings(true);
+                            adjustSize();
+                        }
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_SHIFT;
                         mutexRequest.unlock();
                     } else if (REMOTE_PACKET_CMD_GET_SHIFT == data[REMOTE_REPLY_PACKET_PART_CMD]) {
                         uint8_t shift = qFromLittleEndian<qint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
                         ui->spinBoxShiftSet->setValue(shift);
                         lockShift(false);
                         mutexRequest.lock();
-                        recordIdx = 0;
-                        cmd = REMOTE_PACKET_CMD_GET_RECORD;
+                        cmd = REMOTE_PACKET_CMD_GET_TABLE;
                         mutexRequest.unlock();
-                    } else if (REMOTE_PACKET_CMD_SET_RECORD == data[REMOTE_REPLY_PACKET_PART_CMD]) {
-                        uint8_t idx = qFromLittleEndian<qint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                    } else if (REMOTE_PACKET_CMD_SET_TABLE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        ui->statusbar->showMessage("Timings updated");
+                        lockTimings(false);
                         mutexRequest.lock();
-                        recordIdx = idx + 1;
-                        if (CDI_TIMING_RECORD_SLOTS == recordIdx) {
-                            ui->statusbar->showMessage("Timings updated");
-                            lockTimings(false);
-                            if (ui->checkBoxShiftAutoset->isChecked()) {
-                                cmd = REMOTE_PACKET_CMD_SET_SHIFT;
-                            } else {
-                                cmd = REMOTE_PACKET_CMD_GET_RPS;
-                            }
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
                         }
                         mutexRequest.unlock();
                     } else if (REMOTE_PACKET_CMD_SET_SHIFT == data[REMOTE_REPLY_PACKET_PART_CMD]) {
                         ui->statusbar->showMessage("Shift updated");
                         ui->spinBoxShiftSet->setEnabled(true);
-                        if (!ui->checkBoxShiftAutoset->isChecked()) {
-                            mutexRequest.lock();
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_COMMIT;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_SET_CURVE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        ui->statusbar->showMessage("Curve updated");
+                        ui->checkBoxInterpolate->setEnabled(true);
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_COMMIT;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_SET_MAP == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t map = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t status = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
+                        if (REMOTE_MAP_EDITED == status) {
+                            ui->statusbar->showMessage(QString("Map %1 kept, the device has uncommitted edits").arg(map + 1));
+                        } else {
+                            ui->statusbar->showMessage(QString("Map %1 selected").arg(map + 1));
+                        }
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_SHIFT;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_COMMIT == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                        }
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_SET_CRANK == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        ui->statusbar->showMessage("Cranking updated");
+                        ui->spinBoxCrankSet->setEnabled(true);
+                        ui->pushButtonCrankSet->setEnabled(true);
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                        }
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_SET_PREDICTOR == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        ui->statusbar->showMessage("Predictor updated");
+                        ui->checkBoxPredict->setEnabled(true);
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                        }
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_SET_DWELL == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        ui->statusbar->showMessage("Dwell updated");
+                        ui->doubleSpinBoxDwellSet->setEnabled(true);
+                        ui->pushButtonDwellSet->setEnabled(true);
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
                             cmd = REMOTE_PACKET_CMD_GET_RPS;
-                            mutexRequest.unlock();
                         }
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_TRACE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t tag = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        if (TRACE_KIND_NONE != TRACE_KIND(tag)) {
+                            traceData.append(reinterpret_cast<char *>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]), TRACE_RECORD_LEN);
+                            timerPortReply.start(REMOTE_LINK_REPLY_MS);
+                            return;
+                        }
+                        if (saveTraceFile(traceFileName)) {
+                            ui->statusbar->showMessage(QString("Trace saved, %1 records").arg(traceData.size() / TRACE_RECORD_LEN));
+                        }
+                        lockTimings(false);
+                        mutexRequest.lock();
+                        if (ui->checkBoxShiftAutoset->isChecked()) {
+                            cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                        } else {
+                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                        }
+                        mutexRequest.unlock();
                     } else if (REMOTE_PACKET_CMD_SAVE_MEM == data[REMOTE_REPLY_PACKET_PART_CMD]) {
-                        ui->statusbar->showMessage("EEPROM data updated");
-                        if (!ui->checkBoxShiftAutoset->isChecked()) {
+                        mutexRequest.lock();
+                        cmd = REMOTE_PACKET_CMD_GET_SAVE;
+                        mutexRequest.unlock();
+                    } else if (REMOTE_PACKET_CMD_GET_SAVE == data[REMOTE_REPLY_PACKET_PART_CMD]) {
+                        uint8_t steps = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+                        uint8_t left = qFromLittleEndian<quint8>(&data[REMOTE_REPLY_PACKET_PART_VALUE_1]);
+                        if (steps > 0) {
+                            ui->statusbar->showMessage(QString("Writing data to EEPROM, step %1, %2 bytes left").arg(steps).arg(left));
+                        } else {
+                            ui->statusbar->showMessage("EEPROM data updated");
                             mutexRequest.lock();
-                            cmd = REMOTE_PACKET_CMD_GET_RPS;
+                            if (ui->checkBoxShiftAutoset->isChecked()) {
+                                cmd = REMOTE_PACKET_CMD_SET_SHIFT;
+                            } else {
+                                cmd = REMOTE_PACKET_CMD_GET_RPS;
+                            }
                             mutexRequest.unlock();
                         }
                     } else {
                         ui->statusbar->showMessage("Unknown");
                     }
-                    semaphoreTransmitComplete.release();
+                    portTimeouts = 0;
+                    framesInFlight.removeFirst();
+                    if (framesInFlight.isEmpty()) {
+                        semaphoreTransmitComplete.release();
+                    } else {
+                        timerPortReply.start(REMOTE_LINK_REPLY_MS);
+                    }
                 } else {
-                    timerPortReply.start(timerPortReplyTimeoutMs);
+                    timerPortReply.start(REMOTE_LINK_REPLY_MS);
                 }
             } else {
-                timerPortReply.start(timerPortReplyTimeoutMs);
+                serial.read(reinterpret_cast<char *>(frame), 1);
+                timerPortReply.start(REMOTE_LINK_REPLY_MS);
             }
         }
     }
 }
 
-void MainWindow::portSend() {
-    uint8_t packet[REMOTE_REPLY_PACKET_LEN];
+//NOTE: Trailing zero value bytes are left out, the device reads them as 0
+QByteArray MainWindow::framePacket(const uint8_t *packet) {
+    uint8_t frame[REMOTE_FRAME_LEN_MAX];
+    uint8_t length = REMOTE_FRAME_PAYLOAD_MAX;
+
+    while ((length > 0) && (0 == packet[REMOTE_REPLY_PACKET_PART_VALUE_0 + length - 1])) {
+        length--;
+    }
+    frame[REMOTE_FRAME_PART_HEADER] = REMOTE_FRAME_HEADER;
+    frame[REMOTE_FRAME_PART_LEN] = length;
+    frame[REMOTE_FRAME_PART_SEQ] = ++frameSeq;
+    frame[REMOTE_FRAME_PART_CMD] = packet[REMOTE_REPLY_PACKET_PART_CMD];
+    memcpy(&frame[REMOTE_FRAME_PART_PAYLOAD], &packet[REMOTE_REPLY_PACKET_PART_VALUE_0], length);
+    qToLittleEndian<quint16>(qChecksum(reinterpret_cast<char *>(frame), REMOTE_FRAME_PART_PAYLOAD + length),
+                             &frame[REMOTE_FRAME_PART_PAYLOAD + length]);
+    return QByteArray(reinterpret_cast<char *>(frame), REMOTE_FRAME_OVERHEAD + length);
+}
 
+QByteArray MainWindow::requestFrame(int request) {
+    uint8_t packet[REMOTE_REPLY_PACKET_LEN] = {};
+    packet[REMOTE_REPLY_PACKET_PART_CMD] = request;
+    if (REMOTE_PACKET_CMD_GET_LATENCY == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = latencyIdx;
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_1] = latencyField;
+    } else if (REMOTE_PACKET_CMD_GET_STATS == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = statsIdx;
+    } else if (REMOTE_PACKET_CMD_GET_TABLE == request) {
+        tableData.clear();
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = 0;
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_1] = timingsUi.size();
+    } else if (REMOTE_PACKET_CMD_SET_TABLE == request) {
+        tableData.clear();
+        for (int i = 0; i < timingsUi.size(); i++) {
+            uint8_t value[sizeof(quint32)];
+            quint16 word = (i << REMOTE_RECORD_SLOT_SHIFT) |
+                    qRound(timingsUi[i].timing->value() * timingSteps);
+            qToLittleEndian<quint16>(timingsUi[i].rpm->value(), &value[0]);
+            qToLittleEndian<quint16>(word, &value[sizeof(quint16)]);
+            tableData.append(reinterpret_cast<char *>(value), sizeof(quint32));
+        }
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = 0;
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_1] = timingsUi.size();
+        qToLittleEndian<quint16>(qChecksum(tableData.constData(), tableData.size()), &packet[REMOTE_REPLY_PACKET_PART_VALUE_2]);
+    } else if (REMOTE_PACKET_CMD_SET_BAUD == request) {
+        qToLittleEndian<quint32>(linkRates[linkRateIdx], &packet[REMOTE_REPLY_PACKET_PART_VALUE_0]);
+    } else if (REMOTE_PACKET_CMD_SET_MAP == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = mapIdx;
+    } else if (REMOTE_PACKET_CMD_SET_SHIFT == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = ui->spinBoxShiftSet->value();
+    } else if (REMOTE_PACKET_CMD_SET_CRANK == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = ui->spinBoxCrankSet->value() / 60;
+    } else if (REMOTE_PACKET_CMD_SET_DWELL == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = qRound(ui->doubleSpinBoxDwellSet->value() * CDI_DWELL_UNIT_HZ / 1000.0);
+    } else if (REMOTE_PACKET_CMD_SET_CURVE == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = ui->checkBoxInterpolate->isChecked() ? CDI_CURVE_LINEAR : CDI_CURVE_STEP;
+    } else if (REMOTE_PACKET_CMD_SET_PREDICTOR == request) {
+        packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = ui->checkBoxPredict->isChecked() ? CDI_PREDICTOR_ACCEL : CDI_PREDICTOR_AVERAGE;
+    }
+    return framePacket(packet);
+}
+
+//NOTE: The status polls go out REMOTE_FRAME_WINDOW at a time in the order
+//      their replies chain them, a table upload as SET_TABLE followed by all
+//      its records and anything else one frame at a time. Only the last
+//      frame of an upload is answered.
+void MainWindow::portSend() {
     if (semaphoreTransmitComplete.available() > 0) {
         semaphoreTransmitComplete.acquire(semaphoreTransmitComplete.available());
-        packet[REMOTE_REPLY_PACKET_PART_HEADER] = REMOTE_HEADER;
         mutexRequest.lock();
-        packet[REMOTE_REPLY_PACKET_PART_CMD] = cmd;
-        if (REMOTE_PACKET_CMD_GET_RECORD == cmd) {
-            packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = recordIdx;
-        } else if (REMOTE_PACKET_CMD_SET_RECORD == cmd) {
-            packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = recordIdx;
-            packet[REMOTE_REPLY_PACKET_PART_VALUE_1] = timingsUi[recordIdx].rpm->value() / 60;
-            packet[REMOTE_REPLY_PACKET_PART_VALUE_2] = timingsUi[recordIdx].timing->value();
-        } else if (REMOTE_PACKET_CMD_SET_SHIFT == cmd) {
-            packet[REMOTE_REPLY_PACKET_PART_VALUE_0] = ui->spinBoxShiftSet->value();
+        int request = cmd;
+        int frames = 1;
+        if ((REMOTE_PACKET_CMD_UNDEFINED != pollAfter(request)) && !ui->checkBoxShiftAutoset->isChecked()) {
+            frames = REMOTE_FRAME_WINDOW;
         }
-        mutexRequest.unlock();
-        uint8_t crc = 0;
-        for (int i = REMOTE_REPLY_PACKET_PART_HEADER; i < REMOTE_REPLY_PACKET_PART_CRC; i++) {
-            crc += packet[i];
+        for (int i = 0; i < frames; i++) {
+            serial.write(requestFrame(request));
+            if (REMOTE_PACKET_CMD_SET_TABLE == request) {
+                uint8_t record[REMOTE_REPLY_PACKET_LEN] = {};
+                record[REMOTE_REPLY_PACKET_PART_CMD] = REMOTE_PACKET_CMD_TABLE_RECORD;
+                for (int slot = 0; slot < timingsUi.size(); slot++) {
+                    memcpy(&record[REMOTE_REPLY_PACKET_PART_VALUE_0], tableData.constData() + slot * sizeof(quint32), sizeof(quint32));
+                    serial.write(framePacket(record));
+                }
+            }
+            framesInFlight.append(frameSeq);
+            request = pollAfter(request);
         }
-        packet[REMOTE_REPLY_PACKET_PART_CRC] = crc;
-        timerPortReply.start(timerPortReplyTimeoutMs);
-        serial.write(reinterpret_cast<char *>(packet), REMOTE_REPLY_PACKET_LEN);
+        mutexRequest.unlock();
+        timerPortReply.start(REMOTE_LINK_REPLY_MS);
+    }
+}
+
+int MainWindow::pollAfter(int request) {
+    switch (request) {
+        case REMOTE_PACKET_CMD_GET_RPS:
+            return REMOTE_PACKET_CMD_GET_PERIOD;
+        case REMOTE_PACKET_CMD_GET_PERIOD:
+            return REMOTE_PACKET_CMD_GET_SYNC;
+        case REMOTE_PACKET_CMD_GET_SYNC:
+            return REMOTE_PACKET_CMD_GET_FAULTS;
+        case REMOTE_PACKET_CMD_GET_FAULTS:
+            return REMOTE_PACKET_CMD_GET_LATENCY;
+        case REMOTE_PACKET_CMD_GET_LATENCY:
+            return REMOTE_PACKET_CMD_GET_STATS;
+        case REMOTE_PACKET_CMD_GET_STATS:
+            return REMOTE_PACKET_CMD_GET_RPS;
+        default:
+            return REMOTE_PACKET_CMD_UNDEFINED;
     }
 }
 
+//NOTE: A device without SET_BAUD stays at REMOTE_BAUDRATE, and one that lost
+//      the fast link drops back to it on its own. The next rate down is
+//      offered once both are back.
 void MainWindow::portReplyTimeout() {
     timerPortReply.stop();
+    mutexRequest.lock();
+    framesInFlight.clear();
+    if (REMOTE_PACKET_CMD_SET_BAUD == cmd) {
+        cmd = REMOTE_PACKET_CMD_GET_GEOMETRY;
+    }
+    if ((++portTimeouts >= REMOTE_LINK_RETRIES) && (REMOTE_BAUDRATE != serial.baudRate())) {
+        serial.setBaudRate(REMOTE_BAUDRATE);
+        ui->statusbar->showMessage(QString("Link fell back to %1 baud").arg(REMOTE_BAUDRATE));
+        if (linkRateIdx + 1 < linkRatesCount) {
+            linkRateIdx++;
+            cmd = REMOTE_PACKET_CMD_SET_BAUD;
+        }
+    }
+    mutexRequest.unlock();
+    semaphoreTransmitComplete.release();
+}
+
+void MainWindow::portSettled() {
     semaphoreTransmitComplete.release();
 }
 
@@ -439,19 +847,38 @@ void MainWindow::on_pushButtonShiftSet_released()
     ui->statusbar->showMessage("Writing new shift");
 }
 
+void MainWindow::on_pushButtonCrankSet_released()
+{
+    ui->spinBoxCrankSet->setEnabled(false);
+    ui->pushButtonCrankSet->setEnabled(false);
+    mutexRequest.lock();
+    cmd = REMOTE_PACKET_CMD_SET_CRANK;
+    mutexRequest.unlock();
+    ui->statusbar->showMessage("Writing new cranking speed");
+}
+
+void MainWindow::on_pushButtonDwellSet_released()
+{
+    ui->doubleSpinBoxDwellSet->setEnabled(false);
+    ui->pushButtonDwellSet->setEnabled(false);
+    mutexRequest.lock();
+    cmd = REMOTE_PACKET_CMD_SET_DWELL;
+    mutexRequest.unlock();
+    ui->statusbar->showMessage("Writing new dwell");
+}
+
 void MainWindow::on_pushButtonUpdate_released() {
     bool allOk = true;
 
-    for (int i = 0; i < CDI_TIMING_RECORD_SLOTS; i++) {
+    for (int i = 0; i < timingsUi.size(); i++) {
         bool ok;
-        timingsUi[i].value->text().toInt(&ok);
+        timingsUi[i].value->text().toDouble(&ok);
         allOk &= ok;
     }
     if (allOk) {
         lockTimings(true);
         mutexRequest.lock();
-        recordIdx = 0;
-        cmd = REMOTE_PACKET_CMD_SET_RECORD;
+        cmd = REMOTE_PACKET_CMD_SET_TABLE;
         mutexRequest.unlock();
         ui->statusbar->showMessage("Writing new timings");
     } else {
@@ -490,6 +917,36 @@ void MainWindow::on_checkBoxShiftAutoset_toggled(bool checked)
     mutexRequest.unlock();
 }
 
+void MainWindow::on_checkBoxInterpolate_clicked(bool checked)
+{
+    Q_UNUSED(checked);
+    ui->checkBoxInterpolate->setEnabled(false);
+    mutexRequest.lock();
+    cmd = REMOTE_PACKET_CMD_SET_CURVE;
+    mutexRequest.unlock();
+    ui->statusbar->showMessage("Writing new curve");
+}
+
+void MainWindow::on_checkBoxPredict_clicked(bool checked)
+{
+    Q_UNUSED(checked);
+    ui->checkBoxPredict->setEnabled(false);
+    mutexRequest.lock();
+    cmd = REMOTE_PACKET_CMD_SET_PREDICTOR;
+    mutexRequest.unlock();
+    ui->statusbar->showMessage("Writing new predictor");
+}
+
+void MainWindow::on_comboBoxMap_activated(int index)
+{
+    lockTimings(true);
+    mutexRequest.lock();
+    mapIdx = index;
+    cmd = REMOTE_PACKET_CMD_SET_MAP;
+    mutexRequest.unlock();
+    ui->statusbar->showMessage("Switching map");
+}
+
 void MainWindow::on_actionOpen_triggered()
 {
     QString openDir = ".";
@@ -565,6 +1022,106 @@ void MainWindow::on_actionExit_triggered()
     close();
 }
 
+//NOTE: The time stamps are 16-bit meter counts, so the timeline assumes
+//      less than one counter wrap between two stamped records
+bool MainWindow::saveTraceFile(QString fileName) {
+    static const char *kinds[] = {
+        "none", "edge", "reject", "charge", "delay", "spark", "stall", "lost"
+    };
+    const double usPerTick = 1000000.0 / CDI_FREQUENCY_HZ;
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QMessageBox::critical(this, tr("Error opening file"), tr("Unable to open file"));
+        return false;
+    }
+    QTextStream stream(&file);
+    stream << "time_us,event,index,value,note\n";
+    bool stamped = false;
+    uint16_t lastStamp = 0;
+    qint64 time = 0;
+    qint64 edgeTime = 0;
+    qint64 planned[CDI_SPARKS] = {-1, -1};
+    for (int i = 0; i + TRACE_RECORD_LEN <= traceData.size(); i += TRACE_RECORD_LEN) {
+        TraceRecord record;
+        memcpy(record.bytes, traceData.constData() + i, TRACE_RECORD_LEN);
+        TraceKind kind = TRACE_KIND(record.tag);
+        int index = TRACE_INDEX(record.tag);
+        uint16_t value = qFromLittleEndian<quint16>(&record.bytes[2]);
+        QString note;
+        qint64 rowTime;
+        if (kind > TRACE_KIND_LOST) {
+            continue;
+        }
+        switch (kind) {
+            case TRACE_KIND_EDGE:
+            case TRACE_KIND_REJECT:
+            case TRACE_KIND_SPARK:
+            case TRACE_KIND_STALL:
+                if (stamped) {
+                    time += static_cast<uint16_t>(value - lastStamp);
+                }
+                stamped = true;
+                lastStamp = value;
+                rowTime = time;
+                if (TRACE_KIND_EDGE == kind) {
+                    note = QString("gap %1 us").arg((time - edgeTime) * usPerTick, 0, 'f', 0);
+                    edgeTime = time;
+                } else if ((TRACE_KIND_SPARK == kind) && (index < CDI_SPARKS) && (planned[index] >= 0)) {
+                    note = QString("late %1 us").arg((time - planned[index]) * usPerTick, 0, 'f', 0);
+                    planned[index] = -1;
+                }
+                break;
+            case TRACE_KIND_CHARGE:
+            case TRACE_KIND_DELAY:
+                rowTime = edgeTime;
+                note = QString("at %1 us").arg((edgeTime + value) * usPerTick, 0, 'f', 0);
+                if ((TRACE_KIND_DELAY == kind) && (index < CDI_SPARKS)) {
+                    planned[index] = edgeTime + value;
+                }
+                break;
+            case TRACE_KIND_LOST:
+                rowTime = time;
+                stamped = false;
+                for (int j = 0; j < CDI_SPARKS; j++) {
+                    planned[j] = -1;
+                }
+                note = QString("%1 records lost").arg(value);
+                break;
+            default:
+                continue;
+        }
+        stream << QString("%1,%2,%3,%4,%5\n")
+                  .arg(rowTime * usPerTick, 0, 'f', 0)
+                  .arg(kinds[kind])
+                  .arg(index)
+                  .arg(value)
+                  .arg(note);
+    }
+    file.close();
+    return true;
+}
+
+void MainWindow::on_actionDumpTrace_triggered()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Dump trace"), ".", QString("%1 (*.csv)").arg(tr("Timeline file")));
+    if (!fileName.isEmpty())
+    {
+        if (!fileName.endsWith(".csv"))
+        {
+            fileName.append(".csv");
+        }
+        traceFileName = fileName;
+        traceData.clear();
+        lockTimings(true);
+        mutexRequest.lock();
+        cmd = REMOTE_PACKET_CMD_GET_TRACE;
+        mutexRequest.unlock();
+        ui->statusbar->showMessage("Reading trace");
+    }
+}
+
 void MainWindow::on_actionWriteMemory_triggered()
 {
     if (QMessageBox::Yes == QMessageBox::question(this, tr("Attention"), tr("Write data to EEPROM?"), QMessageBox::Yes | QMessageBox::No)) {
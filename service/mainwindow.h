@@ -32,31 +32,36 @@ private:
     struct TimingUi {
         QLabel *index;
         QSpinBox *rpm;
-        QSpinBox *timing;
+        QDoubleSpinBox *timing;
         QLineEdit *value;
     };
 
     struct TimingRecord {
         int rpm;
-        int timing;
+        double timing;
     };
 
     static constexpr char timingsFileExtension[] = "tim";
+    static constexpr int timingsFileVersion = -2;
 
     static constexpr int rotorSignalChannel = 0;
     static constexpr double rotorSignalAmplitude = 2.0;
 
     static constexpr int timerPortSendPeriodMs = 50;
     static constexpr int timerPortAutoReadPeriodMs = 10;
-    static constexpr int timerPortReplyTimeoutMs = 500;
 
 private:
     void closeEvent(QCloseEvent* e);
     TimingUi createTimingUi(QGridLayout *layout, QString name, int row);
+    void setupTimings(int slots);
     void lockShift(bool lock);
     void lockTimings(bool lock);
     bool loadTimingsFile(QString fileName);
     bool saveTimingsFile(QString fileName);
+    bool saveTraceFile(QString fileName);
+    QByteArray framePacket(const uint8_t *packet);
+    QByteArray requestFrame(int request);
+    int pollAfter(int request);
 
 private slots:
     void setPort(const QString &portname);
@@ -66,15 +71,22 @@ private slots:
     void portRead();
     void portSend();
     void portReplyTimeout();
+    void portSettled();
     void on_pushButtonShiftSet_released();
+    void on_pushButtonCrankSet_released();
+    void on_pushButtonDwellSet_released();
     void on_pushButtonUpdate_released();
     void on_pushButtonGenerate_released();
     void on_pushButtonStop_released();
     void on_checkBoxShiftAutoset_toggled(bool checked);
+    void on_checkBoxInterpolate_clicked(bool checked);
+    void on_checkBoxPredict_clicked(bool checked);
+    void on_comboBoxMap_activated(int index);
     void on_actionOpen_triggered();
     void on_actionSave_triggered();
     void on_actionSaveAs_triggered();
     void on_actionWriteMemory_triggered();
+    void on_actionDumpTrace_triggered();
     void on_actionExit_triggered();
 
 private:
@@ -84,18 +96,33 @@ private:
     QSignalMapper *signalMapperValue;
     QActionGroup *groupPort;
     QList<TimingUi> timingsUi;
+    QList<QLineEdit *> latenciesUi;
+    QList<QLineEdit *> statsUi;
     QSerialPort serial;
     QTimer timerPortSend;
     QTimer timerPortAutoRead;
     QTimer timerPortReply;
     int cmd;
-    int recordIdx;
+    quint8 frameSeq;
+    QList<quint8> framesInFlight;
+    int portTimeouts;
+    int linkRateIdx;
+    int linkOverruns;
+    int timingSteps;
+    int mapIdx;
+    int latencyIdx;
+    int latencyField;
+    quint16 latencyValues[REMOTE_LATENCY_FIELDS];
+    int statsIdx;
     QMutex mutexRequest;
     QSemaphore semaphoreTransmitComplete;
     QActionGroup *groupGenerator;
     TLTR ltrServer;
     QThread threadLtr35;
     QString timingsFileName;
+    QString traceFileName;
+    QByteArray traceData;
+    QByteArray tableData;
     QScopedPointer<Ltr35> ltr35;
 
 };